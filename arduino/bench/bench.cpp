@@ -0,0 +1,137 @@
+/**
+ * @file bench.cpp
+ * @brief Host benchmarks of the firmware hot paths (pio run -e bench -t exec).
+ *        The firmware objects of main.cpp run on the simulated hardware of the native HAL
+ *        with a virtual clock. For every benchmark it prints the host time per iteration and
+ *        how many hardware accesses (pin reads/writes, ADC conversions, SPI transfers, led strip
+ *        updates, bytes sent to the Raspberry) one iteration does: these are what cost time on the Due.
+ *
+ */
+#include <stdio.h>
+#include <Arduino.h>
+#include "Hal.h"
+#include "Looper.h"
+
+#define BENCH_ITERATIONS  20000
+#define BENCH_MESSAGES    1000
+
+// Firmware objects (main.cpp)
+void setup();
+extern Looper looper;
+extern TFT tft;
+extern Track loopTracks[];
+extern const KeypadConfig<4, 4> drumpadConfig;
+
+
+/**
+ * @brief Run fn for iterations times and print cost per iteration
+ *
+ */
+static void runBenchmark(const char* name, uint32_t iterations, void (*fn)()){
+    Serial1.clearTxLog();
+    hal::resetCounters();
+    uint64_t start = hal::nanos();
+    for(uint32_t i=0; i<iterations; i++){
+        fn();
+    }
+    uint64_t elapsed = hal::nanos() - start;
+    hal::Counters& c = hal::counters();
+    printf("%-28s %8u %10.1f %9.2f %9.2f %8.2f %10.2f %7.3f %9.3f\n", name, iterations, (double)elapsed / iterations,
+           (double)c.digitalReads / iterations, (double)c.digitalWrites / iterations, (double)c.analogReads / iterations,
+           (double)c.spiTransfers / iterations, (double)c.ledShows / iterations, (double)Serial1.getTxLog().size() / iterations);
+}
+
+
+/*** Iteration cost ***/
+
+static void benchUpdateIdle(){
+    hal::advanceMicros(100);
+    looper.update();
+}
+
+static void benchScanKeys(){
+    looper.scanKeys();
+}
+
+static void benchUpdateVolumes(){
+    looper.updateVolumes();
+}
+
+static uint32_t _pressCount = 0;
+static void benchPadHit(){
+    uint8_t k = _pressCount++ % 12;                                             // Drum sounds only
+    hal::setMatrixKey(drumpadConfig.rowPins[k / 4], drumpadConfig.colPins[k % 4], true);
+    hal::advanceMicros(DEBOUNCE_TIME * 1000 + 1000);
+    looper.updateKeys();
+    hal::setMatrixKey(drumpadConfig.rowPins[k / 4], drumpadConfig.colPins[k % 4], false);
+    hal::advanceMicros(DEBOUNCE_TIME * 1000 + 1000);
+    looper.updateKeys();
+}
+
+
+/*** Message throughput ***/
+
+static void injectMessages(uint8_t msgId, uint8_t b1, uint8_t b2){
+    for(uint16_t i=0; i<BENCH_MESSAGES; i++){
+        Serial1.inject('0' + msgId);
+        Serial1.inject('0' + b1);
+        Serial1.inject('0' + ((b2 + i) % 8) + 1);
+    }
+}
+
+static void benchCounterMessages(){
+    injectMessages(COUNTER, 1, 4);
+    looper.getDataFromPi();
+}
+
+static void benchStatusMessages(){
+    injectMessages(STATUS, STOP_REC, 0);
+    looper.getDataFromPi();
+}
+
+static void benchSendData(){
+    for(uint16_t i=0; i<BENCH_MESSAGES; i++){
+        looper.sendDataToPi(BTN_PRESSED, i % 12, 0, micros());
+    }
+}
+
+
+/*** Rendering cost ***/
+
+static void benchDrawMenu(){
+    tft.drawMenu();
+}
+
+static void benchDrawPosition(){
+    static uint8_t p = 0;
+    tft.drawPosition(p++ % 8);
+}
+
+static void benchDrawLoopTrack(){
+    static uint8_t t = 0;
+    tft.drawLoopTrack(loopTracks[t++ % 8]);
+}
+
+static void benchDrawBpm(){
+    tft.drawBpm(120);
+}
+
+
+int main(){
+    hal::useVirtualClock(true);
+    setup();
+
+    printf("%-28s %8s %10s %9s %9s %8s %10s %7s %9s\n", "benchmark", "iters", "ns/iter", "dRead", "dWrite", "aRead", "spi", "leds", "txBytes");
+    runBenchmark("Looper::update (idle)",      BENCH_ITERATIONS, benchUpdateIdle);
+    runBenchmark("Looper::scanKeys",           BENCH_ITERATIONS, benchScanKeys);
+    runBenchmark("Looper::updateVolumes",      BENCH_ITERATIONS, benchUpdateVolumes);
+    runBenchmark("pad hit (press+release)",    BENCH_ITERATIONS, benchPadHit);
+    runBenchmark("1000 COUNTER msgs from Pi",  100,              benchCounterMessages);
+    runBenchmark("1000 STATUS msgs from Pi",   100,              benchStatusMessages);
+    runBenchmark("1000 msgs to Pi",            100,              benchSendData);
+    runBenchmark("TFT::drawMenu",              1000,             benchDrawMenu);
+    runBenchmark("TFT::drawPosition",          1000,             benchDrawPosition);
+    runBenchmark("TFT::drawLoopTrack",         1000,             benchDrawLoopTrack);
+    runBenchmark("TFT::drawBpm",               1000,             benchDrawBpm);
+    return 0;
+}
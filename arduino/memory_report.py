@@ -0,0 +1,117 @@
+"""
+RAM / flash usage per module, from the GNU ld map file of the firmware.
+
+PlatformIO extra script of env:due: it adds -Wl,-Map to the link and the target
+    pio run -e due -t memreport
+It can also be run on any map file:
+    python memory_report.py .pio/build/due/firmware.map
+
+Columns (bytes):
+    text    code
+    rodata  constant tables (menu strings, fonts, init commands, key roles): flash only
+    data    initialized variables: RAM, with their initial value in flash
+    bss     zero-initialized variables (objects, buffers, DMA scanline, leds)
+Heap and stack are not in the map: the heap must not grow after setup() ('h' on debug serial: allocations
+counted by the malloc / _malloc_r wrappers, and growth of sbrk(0) since the end of setup()).
+"""
+import os
+import re
+import sys
+import collections
+
+FLASH_SIZE = 512 * 1024         # SAM3X8E
+RAM_SIZE = 96 * 1024
+
+# Output section -> column. .text of the Due linker script also holds .rodata input sections
+SECTIONS = {".text": "text", ".rodata": "rodata", ".ARM.extab": "rodata", ".ARM.exidx": "rodata",
+            ".init_array": "rodata", ".fini_array": "rodata", ".relocate": "data", ".data": "data",
+            ".bss": "bss", ".stack": "bss"}
+COLUMNS = ("text", "rodata", "data", "bss")
+
+# Output section lines may end with "load address 0x..." (.relocate)
+OUTPUT_RE = re.compile(r"^(\.[\w.]+)(\s+0x[0-9a-f]+\s+0x[0-9a-f]+.*)?$")
+INPUT_RE = re.compile(r"^ (\S+)?\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S.*)$")
+NAME_RE = re.compile(r"^ (\.\S+|COMMON)\s*$")
+
+
+def module_name(path):
+    """Object file -> module: source file for the firmware, library for archives"""
+    archive = re.match(r"(.+\.a)\((.+)\)$", path)
+    if archive:
+        return os.path.basename(archive.group(1))
+    name = os.path.basename(path)
+    if name.endswith(".o"):
+        name = name[:-2]
+    return name
+
+
+def parse_map(path):
+    usage = collections.defaultdict(lambda: dict.fromkeys(COLUMNS, 0))
+    column = None
+    input_name = ""
+    in_map = False
+    with open(path) as f:
+        for line in f:
+            line = line.rstrip("\n")
+            if not in_map:
+                in_map = line.startswith("Linker script and memory map")
+                continue
+            output = OUTPUT_RE.match(line)
+            if output:
+                column = SECTIONS.get(output.group(1))
+                if column is None and output.group(1).startswith(".rodata"):
+                    column = "rodata"
+                continue
+            name = NAME_RE.match(line)
+            if name:
+                input_name = name.group(1)
+                continue
+            section = INPUT_RE.match(line)
+            if column is None or not section:
+                continue
+            if section.group(1):
+                input_name = section.group(1)
+            address, size, obj = int(section.group(2), 16), int(section.group(3), 16), section.group(4)
+            if address == 0 or size == 0 or obj.startswith("0x"):
+                continue
+            kind = column
+            if column == "text" and input_name.startswith(".rodata"):
+                kind = "rodata"
+            usage[module_name(obj)][kind] += size
+    return usage
+
+
+def print_report(usage):
+    rows = sorted(usage.items(), key=lambda m: (m[1]["data"] + m[1]["bss"], m[1]["text"] + m[1]["rodata"]), reverse=True)
+    print("%-32s %8s %8s %8s %8s %9s %8s" % ("module", "text", "rodata", "data", "bss", "flash", "ram"))
+    total = dict.fromkeys(COLUMNS, 0)
+    for name, u in rows:
+        for c in COLUMNS:
+            total[c] += u[c]
+        print("%-32s %8d %8d %8d %8d %9d %8d" % (name[:32], u["text"], u["rodata"], u["data"], u["bss"],
+                                                  u["text"] + u["rodata"] + u["data"], u["data"] + u["bss"]))
+    flash = total["text"] + total["rodata"] + total["data"]
+    ram = total["data"] + total["bss"]
+    print("%-32s %8d %8d %8d %8d %9d %8d" % ("total", total["text"], total["rodata"], total["data"], total["bss"], flash, ram))
+    print("flash: %d / %d bytes (%.1f%%)  ram: %d / %d bytes (%.1f%%), %d bytes left for heap and stack" %
+          (flash, FLASH_SIZE, 100.0 * flash / FLASH_SIZE, ram, RAM_SIZE, 100.0 * ram / RAM_SIZE, RAM_SIZE - ram))
+
+
+try:
+    Import("env")
+except NameError:
+    env = None
+
+if env is not None:
+    env.Append(LINKFLAGS=["-Wl,-Map,${BUILD_DIR}/firmware.map"])
+    env.AddCustomTarget(
+        name="memreport",
+        dependencies="$BUILD_DIR/${PROGNAME}.elf",
+        actions=['"$PYTHONEXE" "$PROJECT_DIR/memory_report.py" "$BUILD_DIR/firmware.map"'],
+        title="Memory report",
+        description="RAM / flash usage per module, from the linker map")
+elif __name__ == "__main__":
+    if len(sys.argv) != 2:
+        print("usage: %s <linker map file>" % sys.argv[0])
+        sys.exit(1)
+    print_report(parse_map(sys.argv[1]))
@@ -0,0 +1,200 @@
+#ifndef _NATIVE_ARDUINO_H_
+#define _NATIVE_ARDUINO_H_
+
+/**
+ * @brief Minimal Arduino core for the native (host) build.
+ *        Pins, ADC, clock and serial ports are simulated by the HAL (see Hal.h).
+ *        Only what the firmware and ILI9341_due use is provided.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdio.h>
+#include <string>
+#include <deque>
+#include <vector>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH            0x1
+#define LOW             0x0
+#define INPUT           0x0
+#define OUTPUT          0x1
+#define INPUT_PULLUP    0x2
+#define CHANGE          0x2
+#define FALLING         0x3
+#define RISING          0x4
+
+#define F_CPU           84000000L
+#define VARIANT_MCK     84000000L
+
+#define NUM_DIGITAL_PINS 72
+#define A0              54
+#define A1              55
+
+#define DEC 10
+#define HEX 16
+
+#define PI              3.1415926535897932384626433832795
+#define DEG_TO_RAD      0.017453292519943295769236907684886
+#define RAD_TO_DEG      57.295779513082320876798154814105
+
+#define highByte(w)     ((uint8_t)((w) >> 8))
+#define lowByte(w)      ((uint8_t)((w) & 0xff))
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#ifndef min
+#define min(a, b)       ((a) < (b) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b)       ((a) > (b) ? (a) : (b))
+#endif
+
+#include "avr/pgmspace.h"
+
+// Time
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+// Digital and analog I/O
+void pinMode(uint32_t pin, uint32_t mode);
+void digitalWrite(uint32_t pin, uint32_t value);
+int digitalRead(uint32_t pin);
+int analogRead(uint32_t pin);
+void analogReadResolution(int bits);
+long map(long x, long inMin, long inMax, long outMin, long outMax);
+
+// Interrupts
+void noInterrupts();
+void interrupts();
+void attachInterrupt(uint32_t pin, void (*callback)(), uint32_t mode);
+void detachInterrupt(uint32_t pin);
+#define digitalPinToInterrupt(p)  (p)
+
+// SAM3X PIO registers: ODSR is used by ILI9341_due (SPI_MODE_NORMAL) to toggle CS and DC pins,
+// SODR/CODR/PDSR by the keypad scan. Pin n is bit n%32 of port n/32 (HAL_PORTS ports).
+typedef uint32_t RwReg;
+
+class PioSetRegister{
+    private:
+        uint8_t _port;
+        bool _level;
+    public:
+        PioSetRegister(uint8_t port, bool level){ _port = port; _level = level; }
+        PioSetRegister& operator=(uint32_t mask);
+};
+
+class PioDataStatusRegister{
+    private:
+        uint8_t _port;
+    public:
+        PioDataStatusRegister(uint8_t port){ _port = port; }
+        operator uint32_t() const;
+};
+
+class Pio{
+    public:
+        volatile RwReg PIO_ODSR;
+        PioSetRegister PIO_SODR, PIO_CODR;
+        PioDataStatusRegister PIO_PDSR;
+        Pio(uint8_t port) : PIO_ODSR(0), PIO_SODR(port, true), PIO_CODR(port, false), PIO_PDSR(port) {}
+};
+Pio* digitalPinToPort(uint32_t pin);
+uint32_t digitalPinToBitMask(uint32_t pin);
+#define portOutputRegister(port) (&((port)->PIO_ODSR))
+
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(s))
+
+/**
+ * @brief Arduino String, backed by std::string
+ *
+ */
+class String{
+    private:
+        std::string _s;
+
+    public:
+        String(){}
+        String(const char* s){ if(s) _s = s; }
+        String(const std::string& s){ _s = s; }
+        String(char c){ _s = std::string(1, c); }
+        String(int v, unsigned char base = DEC){ fromLong(v, base); }
+        String(unsigned int v, unsigned char base = DEC){ fromLong(v, base); }
+        String(long v, unsigned char base = DEC){ fromLong(v, base); }
+        String(unsigned long v, unsigned char base = DEC){ fromLong(v, base); }
+        String(unsigned char v, unsigned char base = DEC){ fromLong(v, base); }
+        String(double v, unsigned char decimals = 2){ char b[32]; snprintf(b, sizeof(b), "%.*f", decimals, v); _s = b; }
+
+        const char* c_str() const { return _s.c_str(); }
+        unsigned int length() const { return _s.length(); }
+        char charAt(unsigned int i) const { return i < _s.length() ? _s[i] : 0; }
+        char operator[](unsigned int i) const { return charAt(i); }
+        String& operator+=(const String& o){ _s += o._s; return *this; }
+        String& operator+=(const char* o){ _s += o; return *this; }
+        String& operator+=(char c){ _s += c; return *this; }
+        friend String operator+(const String& a, const String& b){ return String(a._s + b._s); }
+        bool operator==(const String& o) const { return _s == o._s; }
+        bool operator==(const char* o) const { return _s == o; }
+        void toCharArray(char* buf, unsigned int size) const { strncpy(buf, _s.c_str(), size); if(size) buf[size - 1] = 0; }
+
+    private:
+        void fromLong(long v, unsigned char base){
+            char b[34];
+            if(base == HEX) snprintf(b, sizeof(b), "%lx", v);
+            else            snprintf(b, sizeof(b), "%ld", v);
+            _s = b;
+        }
+};
+
+class Print;
+
+class Printable{
+    public:
+        virtual ~Printable(){}
+        virtual size_t printTo(Print& p) const = 0;
+};
+
+/**
+ * @brief Arduino Print: formatting on top of write()
+ *
+ */
+class Print{
+    public:
+        virtual ~Print(){}
+        virtual size_t write(uint8_t c) = 0;
+        virtual size_t write(const uint8_t* buf, size_t size){ size_t n = 0; while(size--) n += write(*buf++); return n; }
+        size_t write(const char* s){ return s ? write((const uint8_t*)s, strlen(s)) : 0; }
+
+        size_t print(const char* s){ return write(s); }
+        size_t print(const String& s){ return write(s.c_str()); }
+        size_t print(const __FlashStringHelper* s){ return write((const char*)s); }
+        size_t print(char c){ return write((uint8_t)c); }
+        size_t print(const Printable& x){ return x.printTo(*this); }
+        size_t print(int v, int base = DEC){ return print((long)v, base); }
+        size_t print(unsigned int v, int base = DEC){ return print((unsigned long)v, base); }
+        size_t print(unsigned char v, int base = DEC){ return print((unsigned long)v, base); }
+        size_t print(long v, int base = DEC){ char b[34]; snprintf(b, sizeof(b), base == HEX ? "%lx" : "%ld", v); return write(b); }
+        size_t print(unsigned long v, int base = DEC){ char b[34]; snprintf(b, sizeof(b), base == HEX ? "%lx" : "%lu", v); return write(b); }
+        size_t print(unsigned long long v){ char b[34]; snprintf(b, sizeof(b), "%llu", v); return write(b); }
+        size_t print(double v, int digits = 2){ char b[40]; snprintf(b, sizeof(b), "%.*f", digits, v); return write(b); }
+
+        size_t println(){ return write("\r\n"); }
+        template <typename T> size_t println(const T& v){ size_t n = print(v); return n + println(); }
+        template <typename T> size_t println(const T& v, int f){ size_t n = print(v, f); return n + println(); }
+};
+
+#include "HardwareSerial.h"
+
+extern HardwareSerial Serial;       // Debug serial: written to stdout
+extern HardwareSerial Serial1;      // Serial to Raspberry: captured by the HAL
+
+#endif
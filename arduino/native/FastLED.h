@@ -0,0 +1,54 @@
+#ifndef _NATIVE_FASTLED_H_
+#define _NATIVE_FASTLED_H_
+
+#include <Arduino.h>
+
+/**
+ * @brief RGB color, same layout and named colors as FastLED CRGB
+ *
+ */
+struct CRGB{
+    typedef enum {
+        Black       = 0x000000,
+        Blue        = 0x0000FF,
+        Cyan        = 0x00FFFF,
+        Green       = 0x008000,
+        GreenYellow = 0xADFF2F,
+        Orange      = 0xFFA500,
+        Red         = 0xFF0000,
+        White       = 0xFFFFFF,
+        Yellow      = 0xFFFF00
+    } HTMLColorCode;
+
+    uint8_t r, g, b;
+
+    CRGB(){ r = 0; g = 0; b = 0; }
+    CRGB(uint8_t ir, uint8_t ig, uint8_t ib){ r = ir; g = ig; b = ib; }
+    CRGB(HTMLColorCode c){ r = (c >> 16) & 0xFF; g = (c >> 8) & 0xFF; b = c & 0xFF; }
+    bool operator==(const CRGB& o) const { return r == o.r && g == o.g && b == o.b; }
+    bool operator!=(const CRGB& o) const { return !(*this == o); }
+};
+
+template <uint8_t DATA_PIN> class NEOPIXEL {};
+
+/**
+ * @brief Simulated led strip. show() is counted by the HAL.
+ *
+ */
+class CFastLED{
+    private:
+        CRGB* _leds;
+        int _nLeds;
+
+    public:
+        CFastLED(){ _leds = NULL; _nLeds = 0; }
+        template <template <uint8_t> class CHIPSET, uint8_t DATA_PIN>
+        CFastLED& addLeds(CRGB* leds, int nLeds){ _leds = leds; _nLeds = nLeds; return *this; }
+        void show();
+        CRGB* getLeds(){ return _leds; }
+        int size(){ return _nLeds; }
+};
+
+extern CFastLED FastLED;
+
+#endif
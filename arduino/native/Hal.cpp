@@ -0,0 +1,358 @@
+#include <chrono>
+#include <thread>
+#include "Hal.h"
+#include <SPI.h>
+#include <FastLED.h>
+
+#define HAL_PINS     NUM_DIGITAL_PINS
+#define HAL_NO_PIN   255
+#define HAL_PORTS    ((HAL_PINS + 31) / 32)
+
+typedef struct {
+    uint32_t period;
+    uint64_t next;
+    void (*callback)();
+    bool active;
+} HalTimer;
+
+static hal::Counters _counters;
+static bool _virtualClock = false;
+static uint64_t _virtualMicros = 0;
+static uint8_t _pinModes[HAL_PINS];
+static uint8_t _inputs[HAL_PINS];
+static uint8_t _outputs[HAL_PINS];
+static int _analogInputs[HAL_PINS];
+static uint32_t _matrix[HAL_PINS];                  // For each column pin: bit r set if the key on row pin r is pressed
+static uint8_t _muxAnalogPin = HAL_NO_PIN, _muxS0, _muxS1, _muxS2;
+static int _muxInputs[8];
+static int _analogResolution = 10;
+static HalTimer _timers[HAL_TIMERS];
+static void (*_pinCallbacks[HAL_PINS])();          // Pin change interrupts, fired by setDigitalInput()
+static uint8_t _pinInterruptModes[HAL_PINS];
+static int _peripheralDepth = 0;                    // > 0 while a simulated peripheral allocates (hal::PeripheralScope)
+static_assert(HAL_PORTS == 3, "_ports initializer");
+static Pio _ports[HAL_PORTS] = {Pio(0), Pio(1), Pio(2)};
+
+HardwareSerial Serial(true);
+HardwareSerial Serial1(false);
+SPIClass SPI;
+static Spi _spi0 = {SPI_SR_RDRF | SPI_SR_TDRE};
+Spi* SPI0 = &_spi0;
+CFastLED FastLED;
+
+
+/*** Clock ***/
+
+static uint64_t realMicros(){
+    static std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+static uint64_t nowMicros(){
+    return _virtualClock ? _virtualMicros : realMicros();
+}
+
+unsigned long micros(){ return (unsigned long)nowMicros(); }
+unsigned long millis(){ return (unsigned long)(nowMicros() / 1000); }
+
+void delay(unsigned long ms){ delayMicroseconds(ms * 1000); }
+
+void delayMicroseconds(unsigned int us){
+    if(_virtualClock)   _virtualMicros += us;
+    else                std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void yield(){}
+void noInterrupts(){}
+void interrupts(){}
+
+void attachInterrupt(uint32_t pin, void (*callback)(), uint32_t mode){
+    if(pin >= HAL_PINS)  return;
+    _pinCallbacks[pin] = callback;
+    _pinInterruptModes[pin] = mode;
+}
+
+void detachInterrupt(uint32_t pin){
+    if(pin < HAL_PINS)  _pinCallbacks[pin] = NULL;
+}
+
+
+/*** Digital and analog I/O ***/
+
+void pinMode(uint32_t pin, uint32_t mode){
+    if(pin >= HAL_PINS)  return;
+    _pinModes[pin] = mode;
+    if(mode == OUTPUT)  _outputs[pin] = LOW;
+}
+
+void digitalWrite(uint32_t pin, uint32_t value){
+    _counters.digitalWrites++;
+    if(pin < HAL_PINS)  _outputs[pin] = value ? HIGH : LOW;
+}
+
+static int pinLevel(uint32_t pin){
+    if(pin >= HAL_PINS)  return LOW;
+    if(_pinModes[pin] == OUTPUT)  return _outputs[pin];
+    for(uint32_t m = _matrix[pin]; m != 0; m &= m - 1){
+        uint8_t r = __builtin_ctz(m);
+        if(_pinModes[r] == OUTPUT && _outputs[r] == LOW)  return LOW;
+    }
+    return _inputs[pin];
+}
+
+int digitalRead(uint32_t pin){
+    _counters.digitalReads++;
+    return pinLevel(pin);
+}
+
+int analogRead(uint32_t pin){
+    _counters.analogReads++;
+    if(pin >= HAL_PINS)  return 0;
+    int value = _analogInputs[pin];
+    if(pin == _muxAnalogPin){
+        uint8_t channel = (_outputs[_muxS2] << 2) | (_outputs[_muxS1] << 1) | _outputs[_muxS0];
+        value = _muxInputs[channel];
+    }
+    return value >> (12 - _analogResolution);      // Values are kept at 12 bit
+}
+
+void analogReadResolution(int bits){
+    _analogResolution = bits;
+}
+
+long map(long x, long inMin, long inMax, long outMin, long outMax){
+    return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+Pio* digitalPinToPort(uint32_t pin){
+    return &_ports[(pin / 32) % HAL_PORTS];
+}
+
+// A write to SODR/CODR sets/clears all the output pins of its mask, and counts as one digitalWrite()
+PioSetRegister& PioSetRegister::operator=(uint32_t mask){
+    _counters.digitalWrites++;
+    for(uint32_t m = mask; m != 0; m &= m - 1){
+        uint32_t pin = _port * 32 + __builtin_ctz(m);
+        if(pin < HAL_PINS)  _outputs[pin] = _level ? HIGH : LOW;
+    }
+    return *this;
+}
+
+// A read of PDSR returns the level of the 32 pins of the port, and counts as one digitalRead()
+PioDataStatusRegister::operator uint32_t() const{
+    _counters.digitalReads++;
+    uint32_t value = 0;
+    for(uint8_t b=0; b<32; b++){
+        if(pinLevel(_port * 32 + b))  value |= (1u << b);
+    }
+    return value;
+}
+
+uint32_t digitalPinToBitMask(uint32_t pin){
+    return 1u << (pin % 32);
+}
+
+
+/*** Peripherals ***/
+
+size_t HardwareSerial::write(uint8_t c){
+    hal::PeripheralScope scope;
+    if(_echo){
+        putchar(c);
+        if(c == '\n')  fflush(stdout);
+    }
+    else{
+        _tx.push_back(c);
+    }
+    return 1;
+}
+
+void HardwareSerial::inject(const uint8_t* buf, size_t size){
+    hal::PeripheralScope scope;
+    _rx.insert(_rx.end(), buf, buf + size);
+}
+
+void HardwareSerial::inject(uint8_t c){
+    hal::PeripheralScope scope;
+    _rx.push_back(c);
+}
+
+uint8_t SPIClass::transfer(uint8_t data){
+    hal::countSpiTransfer();
+    return 0;
+}
+
+SpiTransmitRegister& SpiTransmitRegister::operator=(uint32_t data){
+    hal::countSpiTransfer();
+    return *this;
+}
+
+void CFastLED::show(){
+    hal::countLedShow();
+}
+
+
+namespace hal {
+
+    /**
+     * @brief Use a virtual clock, only moved by advanceMicros()/delay(). Default is host real time.
+     *
+     */
+    void useVirtualClock(bool enable){
+        if(enable && !_virtualClock)  _virtualMicros = realMicros();
+        _virtualClock = enable;
+    }
+
+    /**
+     * @brief Move the virtual clock forward, firing timer interrupts in time order
+     *
+     */
+    void advanceMicros(uint32_t us){
+        uint64_t target = _virtualMicros + us;
+        while(true){
+            HalTimer* next = NULL;
+            for(uint8_t i=0; i<HAL_TIMERS; i++){
+                if(_timers[i].active && _timers[i].next <= target && (next == NULL || _timers[i].next < next->next))  next = &_timers[i];
+            }
+            if(next == NULL)  break;
+            _virtualMicros = next->next;
+            next->next += next->period;
+            _counters.timerInterrupts++;
+            next->callback();
+        }
+        _virtualMicros = target;
+    }
+
+    /**
+     * @brief Fire due timer interrupts (real clock). Missed periods are not fired again.
+     *
+     */
+    void tick(){
+        if(_virtualClock)  return;
+        uint64_t now = realMicros();
+        for(uint8_t i=0; i<HAL_TIMERS; i++){
+            if(_timers[i].active && _timers[i].next <= now){
+                _timers[i].next += _timers[i].period;
+                if(_timers[i].next <= now)  _timers[i].next = now + _timers[i].period;
+                _counters.timerInterrupts++;
+                _timers[i].callback();
+            }
+        }
+    }
+
+    /**
+     * @brief Host monotonic time, used to measure the cost of code on the host
+     *
+     */
+    uint64_t nanos(){
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * @brief Set the level of an input pin. An interrupt attached to the pin fires if its edge matches
+     *
+     */
+    void setDigitalInput(uint8_t pin, int value){
+        if(pin >= HAL_PINS)  return;
+        uint8_t level = value ? HIGH : LOW;
+        if(level == _inputs[pin])  return;
+        _inputs[pin] = level;
+        uint8_t mode = _pinInterruptModes[pin];
+        if(_pinCallbacks[pin] != NULL && (mode == CHANGE || (mode == RISING && level == HIGH) || (mode == FALLING && level == LOW))){
+            _counters.pinInterrupts++;
+            _pinCallbacks[pin]();
+        }
+    }
+
+    /**
+     * @brief Set the voltage on an analog pin
+     *
+     * @param value 12 bit value
+     */
+    void setAnalogInput(uint8_t pin, int value){
+        if(pin < HAL_PINS)  _analogInputs[pin] = value;
+    }
+
+    /**
+     * @brief Press or release the switch between a row pin and a column pin of a key matrix
+     *
+     */
+    void setMatrixKey(uint8_t rowPin, uint8_t colPin, bool pressed){
+        if(rowPin >= 32 || colPin >= HAL_PINS)  return;
+        if(pressed)  _matrix[colPin] |= (1u << rowPin);
+        else         _matrix[colPin] &= ~(1u << rowPin);
+    }
+
+    /**
+     * @brief Connect a CD4051 mux output to an analog pin
+     *
+     */
+    void setMux(uint8_t analogPin, uint8_t s0, uint8_t s1, uint8_t s2){
+        _muxAnalogPin = analogPin;
+        _muxS0 = s0;
+        _muxS1 = s1;
+        _muxS2 = s2;
+    }
+
+    /**
+     * @brief Set the voltage on a mux input
+     *
+     * @param value 12 bit value
+     */
+    void setMuxInput(uint8_t channel, int value){
+        _muxInputs[channel & 7] = value;
+    }
+
+    int getDigitalOutput(uint8_t pin){
+        return pin < HAL_PINS ? _outputs[pin] : LOW;
+    }
+
+    void startTimer(uint8_t channel, uint32_t periodUs, void (*callback)()){
+        HalTimer* t = &_timers[channel];
+        t->period = periodUs;
+        t->next = nowMicros() + periodUs;
+        t->callback = callback;
+        t->active = true;
+    }
+
+    void stopTimer(uint8_t channel){
+        _timers[channel].active = false;
+    }
+
+    Counters& counters(){
+        return _counters;
+    }
+
+    void resetCounters(){
+        memset(&_counters, 0, sizeof(_counters));
+    }
+
+    void countSpiTransfer(){
+        _counters.spiTransfers++;
+    }
+
+    void countLedShow(){
+        _counters.ledShows++;
+    }
+
+    PeripheralScope::PeripheralScope(){
+        _peripheralDepth++;
+    }
+
+    PeripheralScope::~PeripheralScope(){
+        _peripheralDepth--;
+    }
+
+    bool inPeripheral(){
+        return _peripheralDepth > 0;
+    }
+}
+
+
+/**
+ * @brief Inputs are pulled up until the HAL drives them
+ *
+ */
+static struct HalInit{
+    HalInit(){ memset(_inputs, HIGH, sizeof(_inputs)); }
+} _halInit;
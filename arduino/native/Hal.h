@@ -0,0 +1,56 @@
+#ifndef _NATIVE_HAL_H_
+#define _NATIVE_HAL_H_
+
+#include <Arduino.h>
+
+#define HAL_TIMERS  9
+
+/**
+ * @brief Hardware abstraction for the native (host) build.
+ *        It simulates pins, key matrix, CD4051 mux, ADC, clock and hardware timers,
+ *        and counts every access so benchmarks can report how much I/O a code path does.
+ */
+namespace hal {
+
+    typedef struct {
+        uint32_t digitalReads, digitalWrites, analogReads;     // PIO register reads/writes count as one pin read/write
+        uint32_t spiTransfers, ledShows;
+        uint32_t timerInterrupts, pinInterrupts;
+    } Counters;
+
+    // Clock
+    void useVirtualClock(bool enable);
+    void advanceMicros(uint32_t us);
+    void tick();
+    uint64_t nanos();
+
+    // Inputs
+    void setDigitalInput(uint8_t pin, int value);
+    void setAnalogInput(uint8_t pin, int value);
+    void setMatrixKey(uint8_t rowPin, uint8_t colPin, bool pressed);
+    void setMux(uint8_t analogPin, uint8_t s0, uint8_t s1, uint8_t s2);
+    void setMuxInput(uint8_t channel, int value);
+
+    // Outputs
+    int getDigitalOutput(uint8_t pin);
+
+    // Hardware timers (used by the native HwTimer)
+    void startTimer(uint8_t channel, uint32_t periodUs, void (*callback)());
+    void stopTimer(uint8_t channel);
+
+    // Access counters
+    Counters& counters();
+    void resetCounters();
+    void countSpiTransfer();
+    void countLedShow();
+
+    // Heap: allocations made by the simulated peripherals (serial logs and queues) are not firmware allocations
+    class PeripheralScope{
+        public:
+            PeripheralScope();
+            ~PeripheralScope();
+    };
+    bool inPeripheral();
+}
+
+#endif
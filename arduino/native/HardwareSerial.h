@@ -0,0 +1,42 @@
+#ifndef _NATIVE_HARDWARE_SERIAL_H_
+#define _NATIVE_HARDWARE_SERIAL_H_
+
+/**
+ * @brief Simulated UART.
+ *        Received bytes are injected with inject(), transmitted bytes are kept in a log
+ *        (or printed on stdout when echo is enabled).
+ */
+class HardwareSerial : public Print{
+    private:
+        std::deque<uint8_t> _rx;
+        std::vector<uint8_t> _tx;
+        bool _echo;
+        unsigned long _baudRate;
+
+    public:
+        HardwareSerial(bool echo){ _echo = echo; _baudRate = 0; }
+        void begin(unsigned long baudRate){ _baudRate = baudRate; }
+        void end(){}
+        int available(){ return (int)_rx.size(); }
+        int peek(){ return _rx.empty() ? -1 : _rx.front(); }
+        int read(){
+            if(_rx.empty())  return -1;
+            uint8_t c = _rx.front();
+            _rx.pop_front();
+            return c;
+        }
+        void flush(){}
+        int availableForWrite(){ return 128; }
+        size_t write(uint8_t c);
+        using Print::write;
+        operator bool(){ return true; }
+
+        // HAL side
+        void inject(const uint8_t* buf, size_t size);
+        void inject(uint8_t c);
+        const std::vector<uint8_t>& getTxLog(){ return _tx; }
+        void clearTxLog(){ _tx.clear(); }
+        unsigned long getBaudRate(){ return _baudRate; }
+};
+
+#endif
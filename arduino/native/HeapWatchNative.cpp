@@ -0,0 +1,40 @@
+#include <new>
+#include <stdlib.h>
+#include "HeapWatch.h"
+#include "Hal.h"
+
+/**
+ * @brief Native HeapWatch: operator new is replaced to report the firmware allocations.
+ *        Allocations of the simulated peripherals (hal::PeripheralScope) are not counted.
+ *        Without sbrk the heap high-water mark is not available: only allocations are counted.
+ */
+static void* allocate(size_t size){
+    if(!hal::inPeripheral())    HeapWatch::countAllocation(size);
+    void* p = malloc(size != 0 ? size : 1);
+    if(p == NULL)   throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(size_t size){
+    return allocate(size);
+}
+
+void* operator new[](size_t size){
+    return allocate(size);
+}
+
+void operator delete(void* p) noexcept{
+    free(p);
+}
+
+void operator delete[](void* p) noexcept{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept{
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept{
+    free(p);
+}
@@ -0,0 +1,18 @@
+#include "HwTimer.h"
+#include "Hal.h"
+
+/**
+ * @brief Native HwTimer: the callback is fired by the HAL clock (hal::tick() or hal::advanceMicros())
+ *
+ */
+HwTimer::HwTimer(uint8_t channel){
+    _channel = channel;
+}
+
+void HwTimer::start(uint32_t periodUs, HwTimerCallback callback, uint8_t priority){
+    hal::startTimer(_channel, periodUs, callback);
+}
+
+void HwTimer::stop(){
+    hal::stopTimer(_channel);
+}
@@ -0,0 +1,12 @@
+#include "Keypad.h"
+#include "Hal.h"
+
+/**
+ * @brief Native settle wait: simulated pins settle at once, but the host time is spent
+ *        so benchmarks show the cost of the wait. The virtual clock is not moved.
+ *
+ */
+void KeypadBase::settle(uint32_t us){
+    uint64_t end = hal::nanos() + us * 1000ULL;
+    while(hal::nanos() < end);
+}
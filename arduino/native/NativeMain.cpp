@@ -0,0 +1,35 @@
+#include <poll.h>
+#include <unistd.h>
+#include <Arduino.h>
+#include "Hal.h"
+
+void setup();
+void loop();
+
+/**
+ * @brief Forward bytes typed on stdin to the debug serial (Serial), like the serial monitor does
+ *
+ */
+static void readStdin(){
+    struct pollfd fd = {STDIN_FILENO, POLLIN, 0};
+    uint8_t buf[64];
+    if(poll(&fd, 1, 0) > 0 && (fd.revents & POLLIN)){
+        ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+        if(n > 0)  Serial.inject(buf, n);
+    }
+}
+
+/**
+ * @brief Run the firmware on the host with the simulated hardware.
+ *        Optional argument: number of loop() iterations (default: run forever)
+ */
+int main(int argc, char** argv){
+    long iterations = argc > 1 ? atol(argv[1]) : -1;
+    setup();
+    for(long i=0; iterations < 0 || i < iterations; i++){
+        readStdin();
+        hal::tick();
+        loop();
+    }
+    return 0;
+}
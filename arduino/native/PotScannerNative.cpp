@@ -0,0 +1,36 @@
+#include "PotScanner.h"
+#include "HwTimer.h"
+
+/**
+ * @brief Native PotScanner: a HAL timer emulates the triggered conversions.
+ *        The timer is restarted with the time until the next sequence, as the interrupt sets RC on the Due.
+ *
+ */
+static PotScanner* _scanner = NULL;
+static uint8_t _muxPin, _directPin;
+static HwTimer _timer(POT_SCAN_TIMER);
+
+static void convert(){
+    uint8_t sequence = _scanner->getSequence();
+    uint16_t muxValue = (sequence & POT_SEQ_MUX) ? analogRead(_muxPin) : 0;
+    uint16_t directValue = (sequence & POT_SEQ_DIRECT) ? analogRead(_directPin) : 0;
+    _timer.start(_scanner->storeSample(muxValue, directValue), convert);
+}
+
+void PotScanner::start(uint32_t settleUs){
+    _scanner = this;
+    _settleUs = settleUs;
+    const uint8_t sel[3] = {_muxS0, _muxS1, _muxS2};
+    for(uint8_t b=0; b<3; b++){
+        pinMode(sel[b], OUTPUT);
+        _selPorts[b] = digitalPinToPort(sel[b]);
+        _selMasks[b] = digitalPinToBitMask(sel[b]);
+    }
+    _muxChannel = 0;
+    _sequence = POT_SEQ_MUX | POT_SEQ_DIRECT;
+    selectMux(0);
+    _muxPin = _muxAnalogIn;
+    _directPin = _directAnalogIn;
+    analogReadResolution(12);
+    _timer.start(settleUs, convert);
+}
@@ -0,0 +1,55 @@
+#ifndef _NATIVE_SPI_H_
+#define _NATIVE_SPI_H_
+
+#include <Arduino.h>
+
+#define MSBFIRST            1
+#define LSBFIRST            0
+#define SPI_MODE0           0x02
+#define SPI_CONTINUE        0
+#define SPI_LAST            1
+#define SPI_CLOCK_DIV2      2
+
+/**
+ * @brief Simulated SPI bus. Every transfer is counted by the HAL, nothing is sent.
+ *
+ */
+class SPIClass{
+    public:
+        void begin(){}
+        void end(){}
+        uint8_t transfer(uint8_t data);
+        void setClockDivider(uint8_t divider){}
+        void setBitOrder(uint8_t order){}
+        void setDataMode(uint8_t mode){}
+};
+
+extern SPIClass SPI;
+
+// SAM3X SPI0 registers used directly by ILI9341_due scanline transfers
+#define SPI_SR_RDRF                 (0x1u << 0)
+#define SPI_SR_TDRE                 (0x1u << 1)
+#define SPI_TDR_LASTXFER            (0x1u << 24)
+#define SPI_PCS(value)              ((0xFu & ~(1u << (value))) << 16)
+#define BOARD_SPI_DEFAULT_SS        10
+#define BOARD_PIN_TO_SPI_CHANNEL(p) 0
+
+/**
+ * @brief Transmit data register: a write is a transfer on the bus
+ *
+ */
+class SpiTransmitRegister{
+    public:
+        SpiTransmitRegister& operator=(uint32_t data);
+};
+
+typedef struct {
+    uint32_t SPI_SR;                // Always ready
+    SpiTransmitRegister SPI_TDR;
+    uint32_t SPI_RDR;
+    uint32_t SPI_CSR[4];
+} Spi;
+
+extern Spi* SPI0;
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef _NATIVE_PGMSPACE_H_
+#define _NATIVE_PGMSPACE_H_
+
+#include <stdint.h>
+
+// On the host flash and RAM share the same address space
+#define PROGMEM
+#define PSTR(s)                 (s)
+#define PGM_P                   const char*
+#define pgm_read_byte(addr)     (*(const uint8_t*)(addr))
+#define pgm_read_word(addr)     (*(const uint16_t*)(addr))
+#define pgm_read_dword(addr)    (*(const uint32_t*)(addr))
+#define pgm_read_ptr(addr)      (*(void* const*)(addr))
+
+#endif
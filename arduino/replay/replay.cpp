@@ -0,0 +1,170 @@
+/**
+ * @file replay.cpp
+ * @brief Replay an input trace recorded on the Due (env:due_trace, see src/InputTrace.h) through the firmware
+ *        running on the simulated hardware of the native HAL.
+ *        The virtual clock is moved to the time of every record before applying it, and loop() is called
+ *        every REPLAY_STEP_US of virtual time: the result only depends on the trace, and it runs faster than real time.
+ *
+ *        Usage: program <trace file> [bytes sent to Pi file] [per iteration timing csv]
+ *          - bytes sent to Pi: exact Serial1 stream written by Looper::sendDataToPi()
+ *          - timing csv: virtual time (us), host time of loop() (ns), bytes sent to Pi, for each iteration
+ *        A summary (iterations, speed, loop() time percentiles, allocations after setup()) is printed on stdout.
+ *
+ */
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <Arduino.h>
+#include "Hal.h"
+#include "Looper.h"
+#include "InputTrace.h"
+#include "HeapWatch.h"
+
+#define REPLAY_STEP_US        50                // Virtual time between two loop() calls
+#define REPLAY_TAIL_US        1000000           // Run after the last record, to send pending messages
+#define REPLAY_HISTOGRAM_NS   100000            // loop() times are kept with 1 ns resolution up to this value
+
+// Firmware objects (main.cpp)
+void setup();
+void loop();
+extern Track loopTracks[];
+
+typedef struct {
+    uint64_t time;                              // us from the first record
+    uint8_t type, pin, channel;
+    uint16_t value;
+} ReplayRecord;
+
+static std::vector<uint32_t> _histogram(REPLAY_HISTOGRAM_NS + 1);      // Last bucket: longer times
+static uint32_t _maxNs = 0;
+
+
+/**
+ * @brief Read a trace file. Bytes before the header (debug prints) are skipped.
+ *        Record times are made relative to the first record, taking care of the micros() overflow.
+ *
+ * @return int analog bits of the trace, -1 on error
+ */
+static int readTrace(const char* fileName, std::vector<ReplayRecord>& records){
+    FILE* f = fopen(fileName, "rb");
+    if(f == NULL)  return -1;
+    std::vector<uint8_t> data;
+    uint8_t buf[4096];
+    size_t n;
+    while((n = fread(buf, 1, sizeof(buf), f)) > 0)  data.insert(data.end(), buf, buf + n);
+    fclose(f);
+
+    size_t pos = 0;
+    while(pos + 6 <= data.size() && memcmp(&data[pos], TRACE_MAGIC, 4) != 0)  pos++;
+    if(pos + 6 > data.size() || data[pos + 4] != TRACE_VERSION)  return -1;
+    int analogBits = data[pos + 5];
+    pos += 6;
+
+    uint32_t last = 0;
+    uint64_t time = 0;
+    for(; pos + TRACE_RECORD_SIZE <= data.size(); pos += TRACE_RECORD_SIZE){
+        const uint8_t* b = &data[pos];
+        uint32_t t = b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+        if(records.empty())  last = t;
+        time += (uint32_t)(t - last);
+        last = t;
+        ReplayRecord r = {time, b[4], b[5], b[6], (uint16_t)(b[7] | (b[8] << 8))};
+        records.push_back(r);
+        if(r.type == TRACE_REC_END)  break;
+    }
+    return analogBits;
+}
+
+/**
+ * @brief Set a recorded input on the simulated hardware
+ *
+ */
+static void applyRecord(const ReplayRecord& r, int analogBits){
+    switch(r.type){
+        case TRACE_REC_DIGITAL: hal::setDigitalInput(r.pin, r.value); break;
+        case TRACE_REC_MATRIX:  hal::setMatrixKey(r.pin, r.channel, r.value); break;
+        case TRACE_REC_ANALOG:
+            if(r.channel == TRACE_NO_CHANNEL)   hal::setAnalogInput(r.pin, r.value << (12 - analogBits));
+            else                                hal::setMuxInput(r.channel, r.value << (12 - analogBits));
+            break;
+        case TRACE_REC_SERIAL:  Serial1.inject((uint8_t)r.value); break;
+        case TRACE_REC_END:
+            if(r.value > 0)  fprintf(stderr, "warning: %u records dropped while tracing\n", r.value);
+            break;
+    }
+}
+
+static uint32_t percentile(uint64_t count, uint8_t p){
+    uint64_t target = (count * p + 99) / 100, acc = 0;
+    for(uint32_t ns=0; ns<=REPLAY_HISTOGRAM_NS; ns++){
+        acc += _histogram[ns];
+        if(acc >= target)  return ns < REPLAY_HISTOGRAM_NS ? ns : _maxNs;
+    }
+    return _maxNs;
+}
+
+
+int main(int argc, char** argv){
+    if(argc < 2){
+        fprintf(stderr, "usage: %s <trace file> [bytes sent to Pi file] [per iteration timing csv]\n", argv[0]);
+        return 1;
+    }
+    std::vector<ReplayRecord> records;
+    int analogBits = readTrace(argv[1], records);
+    if(analogBits < 0 || records.empty()){
+        fprintf(stderr, "%s: not a trace file, or empty trace\n", argv[1]);
+        return 1;
+    }
+    FILE* timing = argc > 3 ? fopen(argv[3], "w") : NULL;
+    if(timing != NULL)  fprintf(timing, "time_us,loop_ns,tx_bytes\n");
+
+    hal::useVirtualClock(true);
+    hal::setMux(loopTracks[0].getAnalogIn(), loopTracks[0].getMuxS0(), loopTracks[0].getMuxS1(), loopTracks[0].getMuxS2());
+    setup();
+    Serial1.clearTxLog();
+
+    uint64_t now = 0, end = records.back().time + REPLAY_TAIL_US, iterations = 0, loopNs = 0;
+    size_t next = 0;
+    uint64_t start = hal::nanos();
+    while(now < end){
+        uint64_t target = now + REPLAY_STEP_US;
+        while(next < records.size() && records[next].time <= target){
+            hal::advanceMicros(records[next].time - now);
+            now = records[next].time;
+            applyRecord(records[next++], analogBits);
+        }
+        hal::advanceMicros(target - now);
+        now = target;
+
+        size_t txBefore = Serial1.getTxLog().size();
+        uint64_t t0 = hal::nanos();
+        loop();
+        uint32_t ns = (uint32_t)(hal::nanos() - t0);
+        _histogram[ns < REPLAY_HISTOGRAM_NS ? ns : REPLAY_HISTOGRAM_NS]++;
+        if(ns > _maxNs)  _maxNs = ns;
+        loopNs += ns;
+        iterations++;
+        if(timing != NULL)  fprintf(timing, "%llu,%u,%u\n", (unsigned long long)now, ns, (unsigned)(Serial1.getTxLog().size() - txBefore));
+    }
+    uint64_t elapsed = hal::nanos() - start;
+    if(timing != NULL)  fclose(timing);
+
+    const std::vector<uint8_t>& tx = Serial1.getTxLog();
+    if(argc > 2){
+        FILE* f = fopen(argv[2], "wb");
+        if(f == NULL){
+            fprintf(stderr, "%s: cannot write\n", argv[2]);
+            return 1;
+        }
+        fwrite(tx.data(), 1, tx.size(), f);
+        fclose(f);
+    }
+
+    printf("records: %zu  trace: %.3f s  replay: %.3f s (x%.1f)\n", records.size(), records.back().time / 1e6,
+           elapsed / 1e9, (records.back().time * 1e3) / (elapsed > 0 ? elapsed : 1));
+    printf("iterations: %llu  bytes sent to Pi: %zu\n", (unsigned long long)iterations, tx.size());
+    printf("loop() ns  avg: %.1f  p50: %u  p99: %u  max: %u\n", (double)loopNs / iterations,
+           percentile(iterations, 50), percentile(iterations, 99), _maxNs);
+    printf("allocations after setup: %u\n", (unsigned)HeapWatch::getAllocations());
+    return 0;
+}
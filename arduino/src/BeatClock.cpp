@@ -0,0 +1,74 @@
+#include "BeatClock.h"
+
+static BeatClock* _clock = NULL;
+
+static void beatIsr(){
+    _clock->tick();
+}
+
+/**
+ * @brief Construct a new BeatClock
+ *
+ * @param timerChannel Timer Counter channel (0-8) of the step timer
+ */
+BeatClock::BeatClock(uint8_t timerChannel) : _timer(timerChannel){
+    _step = 0;
+    _bars = 0;
+    _barPeriod = 0;
+    _lastSync = 0;
+}
+
+/**
+ * @brief Start of a bar received from Pd. Update the bar period and restart the position from step 0.
+ *
+ * @param now micros() at the reception
+ */
+void BeatClock::sync(uint32_t now){
+    uint32_t interval = now - _lastSync;
+    _lastSync = now;
+    if(_bars > 0 && interval >= BEAT_MIN_BAR && interval <= BEAT_MAX_BAR){
+        uint32_t tolerance = _barPeriod >> BEAT_TEMPO_CHANGE;
+        if(interval > _barPeriod + tolerance || interval + tolerance < _barPeriod)  _barPeriod = interval;     // First bar or new tempo
+        else    _barPeriod += ((int32_t)interval - (int32_t)_barPeriod) >> BEAT_PERIOD_SHIFT;
+    }
+    _bars++;
+    _clock = this;
+    _timer.stop();
+    _step = 0;
+    if(_barPeriod != 0)     _timer.start(_barPeriod / BEAT_STEPS, beatIsr);
+}
+
+/**
+ * @brief Next step of the bar. Called by the timer interrupt.
+ *
+ */
+void BeatClock::tick(){
+    if(_step < BEAT_STEPS - 1)  _step++;
+}
+
+/**
+ * @brief Position in the bar
+ *
+ * @return uint8_t 0 to BEAT_STEPS - 1
+ */
+uint8_t BeatClock::getStep(){
+    return _step;
+}
+
+/**
+ * @brief Number of syncs received: changes at every bar
+ *
+ * @return uint32_t
+ */
+uint32_t BeatClock::getBars(){
+    return _bars;
+}
+
+/**
+ * @brief Estimated bar period
+ *
+ * @return uint32_t us, 0 if unknown
+ */
+uint32_t BeatClock::getBarPeriod(){
+    return _barPeriod;
+}
@@ -0,0 +1,37 @@
+#ifndef _BEAT_CLOCK_H_
+#define _BEAT_CLOCK_H_
+
+#include <Arduino.h>
+#include "HwTimer.h"
+
+#define BEAT_STEPS          16          // Steps of the loop position bar in a bar
+#define BEAT_MIN_BAR        500000      // us. Shorter sync intervals are ignored for the tempo (repeated sync)
+#define BEAT_MAX_BAR        20000000    // us. Longer sync intervals are ignored for the tempo (metronome stopped)
+#define BEAT_PERIOD_SHIFT   2           // Smoothing of the bar period: 1/2^BEAT_PERIOD_SHIFT of a new interval
+#define BEAT_TEMPO_CHANGE   3           // A bar 1/2^BEAT_TEMPO_CHANGE off the estimate is a new tempo, not jitter
+
+/**
+ * @brief This class animate the loop position between the bar syncs sent by Pd (COUNTER message, count 0).
+ *        The bar period is estimated from the interval between syncs: smoothed against the serial jitter,
+ *        replaced at once when the tempo changes. A hardware timer moves the position by one step every
+ *        bar period / BEAT_STEPS; every sync brings it back to step 0 (phase correction).
+ *        Without sync the position stops at the last step of the bar.
+ */
+class BeatClock{
+    private:
+        HwTimer _timer;
+        volatile uint8_t _step;
+        uint32_t _bars;
+        uint32_t _barPeriod;            // us, 0 until two syncs have been received
+        uint32_t _lastSync;
+
+    public:
+        BeatClock(uint8_t timerChannel);
+        void sync(uint32_t now);
+        void tick();
+        uint8_t getStep();
+        uint32_t getBars();
+        uint32_t getBarPeriod();
+};
+
+#endif
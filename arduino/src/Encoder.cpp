@@ -1,4 +1,15 @@
 #include "Encoder.h"
+#include "InputTrace.h"
+
+// Quadrature transition table, indexed by previous state << 2 | state (state: CLK << 1 | DT).
+// CW: 00 -> 10 -> 11 -> 01 -> 00. Invalid transitions (both pins changed) count 0
+static const int8_t ENC_TRANSITIONS[16] = {0, -1, 1, 0, 1, 0, 0, -1, -1, 0, 0, 1, 0, 1, -1, 0};
+
+static Encoder* _encoder = NULL;
+
+static void encoderIsr(){
+    _encoder->decode();
+}
 
 /**
  * @brief Construct a new Encoder object
@@ -19,45 +30,104 @@ Encoder::Encoder(uint8_t pinCLK, uint8_t pinDT, uint8_t pinSW, long ppr, uint8_t
 
 /**
  * @brief Initialize Encoder object. 
- *        Setting the pin as INPUT. Reset pulse count.
+ *        Setting the pin as INPUT. Reset pulse count. Attach the decoder to CLK and DT pin changes.
  * 
  */
 void Encoder::init(){
     pinMode(_pinCLK, INPUT);
     pinMode(_pinDT, INPUT);
     pinMode(_pinSW,INPUT);
-    _lastStateCLK = digitalRead(_pinCLK);
+    _portCLK = digitalPinToPort(_pinCLK);
+    _portDT = digitalPinToPort(_pinDT);
+    _maskCLK = digitalPinToBitMask(_pinCLK);
+    _maskDT = digitalPinToBitMask(_pinDT);
+    _state = (digitalRead(_pinCLK) << 1) | digitalRead(_pinDT);
+    _transitions = 0;
+    _lastDetentDir = 0;
     _count = 0;
+    _position = 0;
+    _readPosition = 0;
+    _pollPosition = 0;
+    _detentTime = micros();
+    _detentPeriod = ENC_ACCEL_MEDIUM;
+    _dir = IDLE;
+    _pressedLatch = false;
+    _longPressLatch = false;
+    _longPressFired = false;
+    _encoder = this;
+    attachInterrupt(digitalPinToInterrupt(_pinCLK), encoderIsr, CHANGE);
+    attachInterrupt(digitalPinToInterrupt(_pinDT), encoderIsr, CHANGE);
+}
+
+
+/**
+ * @brief Decode a CLK/DT change. Called from the pin change interrupt.
+ * 
+ */
+void Encoder::decode(){
+    uint8_t state = ((_portCLK->PIO_PDSR & _maskCLK) ? 2 : 0) | ((_portDT->PIO_PDSR & _maskDT) ? 1 : 0);
+    TRACE_DIGITAL(_pinCLK, state >> 1);
+    TRACE_DIGITAL(_pinDT, state & 1);
+    _transitions += ENC_TRANSITIONS[(_state << 2) | state];
+    _state = state;
+    if(state != ENC_REST_STATE)     return;
+    if(_transitions >= ENC_STEP_TRANSITIONS / 2)         detent(1);      // Half a detent: an edge may have been missed
+    else if(_transitions <= -ENC_STEP_TRANSITIONS / 2)   detent(-1);
+    _transitions = 0;                                   // Resync at every rest state
 }
 
 
 /**
- * @brief Read input pin and update pulse counter and direction.
- *        It count from 0 to ppr.
- *        Read button switch.
+ * @brief Count a detent and update the velocity estimate. A reversal or a pause restarts from one step per detent.
+ * 
+ * @param dir 1: CW  -1: CCW
+ */
+void Encoder::detent(int8_t dir){
+    uint32_t now = micros();
+    uint32_t period = now - _detentTime;
+    _detentTime = now;
+    if(dir != _lastDetentDir || period >= ENC_ACCEL_MEDIUM)    _detentPeriod = period;
+    else    _detentPeriod += ((int32_t)period - (int32_t)_detentPeriod) >> ENC_VELOCITY_SHIFT;
+    _lastDetentDir = dir;
+    uint8_t scale = (_detentPeriod < ENC_ACCEL_FAST) ? 4 : ((_detentPeriod < ENC_ACCEL_MEDIUM) ? 2 : 1);
+    _position += dir * scale;
+    long count = _count - dir;
+    if(count > _ppr)     count = 0;
+    else if(count < 0)   count = _ppr;
+    _count = count;
+}
+
+
+/**
+ * @brief Update direction (steps since the last call) and read button switch.
+ *        A press is reported on release, unless it has been held for
+ *        ENC_LONG_PRESS_TIME ms (long press, reported while still held).
+ *        Steps and button presses are accumulated until read with readSteps() and readPressed(),
+ *        so the encoder can be polled faster than the menu is updated.
  */
 void Encoder::updateEncoder(){
-	_currentStateCLK = digitalRead(_pinCLK);
     _currentStateSW = !digitalRead(_pinSW); // Active low
-	if (_currentStateCLK != _lastStateCLK  && _currentStateCLK == 1){
-		if (digitalRead(_pinDT) != _currentStateCLK) {
-			_count --;
-            _dir = CW;
-		} else {
-			_count ++;
-            _dir = CCW;
-		}
-        if(_count > _ppr)    _count = 0;
-        else if(_count < 0)  _count = _ppr;
+    TRACE_DIGITAL(_pinSW, !_currentStateSW);
+    int32_t position = _position;
+    if(position > _pollPosition)        _dir = CW;
+    else if(position < _pollPosition)   _dir = CCW;
+    else                                _dir = IDLE;
+    _pollPosition = position;
+
+    _pressed = false;
+    if(_currentStateSW && _currentStateSW != _lastStateSW){                 // Switch pressed
+        _swPressTime = millis();
+        _longPressFired = false;
     }
-    else{
-        _dir = IDLE;
+    else if(_currentStateSW && !_longPressFired && (millis() - _swPressTime) > ENC_LONG_PRESS_TIME){
+        _longPressFired = true;
+        _longPressLatch = true;
     }
+    else if(!_currentStateSW && _currentStateSW != _lastStateSW && !_longPressFired){   // Released before long press
+        _pressed = true;
+    }
+    if(_pressed)    _pressedLatch = true;
 
-    if(_currentStateSW && _currentStateSW != _lastStateSW)    _pressed = true;
-    else                                                      _pressed = false;
-
-	_lastStateCLK = _currentStateCLK;
     _lastStateSW = _currentStateSW;
 }
 
@@ -98,6 +168,40 @@ bool Encoder::isMoving(){
     else             return false;
 }
 
+/**
+ * @brief Return steps accumulated since last call, scaled by the spin velocity
+ * 
+ * @return int16_t Positive: CW  Negative: CCW
+ */
+int16_t Encoder::readSteps(){
+    int32_t position = _position;
+    int16_t steps = position - _readPosition;
+    _readPosition = position;
+    return steps;
+}
+
+/**
+ * @brief Return true if the switch button has been pressed since last call
+ * 
+ * @return bool
+ */
+bool Encoder::readPressed(){
+    bool pressed = _pressedLatch;
+    _pressedLatch = false;
+    return pressed;
+}
+
+/**
+ * @brief Return true if the switch button has been held for ENC_LONG_PRESS_TIME since last call
+ * 
+ * @return bool
+ */
+bool Encoder::readLongPressed(){
+    bool pressed = _longPressLatch;
+    _longPressLatch = false;
+    return pressed;
+}
+
 void Encoder::debug(){
     if(isMoving()){
         Serial.print("DIRECTION ");
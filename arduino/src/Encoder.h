@@ -4,32 +4,65 @@
 
 #include <Arduino.h>
 
+#define ENC_LONG_PRESS_TIME 2000    // ms
+#define ENC_STEP_TRANSITIONS 4      // Quadrature transitions per detent
+#define ENC_REST_STATE      0x03    // CLK and DT high: state of the encoder at a detent
+#define ENC_ACCEL_FAST      15000   // us per detent: steps x4 below
+#define ENC_ACCEL_MEDIUM    40000   // us per detent: steps x2 below
+#define ENC_VELOCITY_SHIFT  2       // Smoothing of the detent period: 1/2^ENC_VELOCITY_SHIFT of a new period
+
 typedef enum {IDLE, CW, CCW}EncoderState;
 
 
 
 /**
  * @brief This class control an incremental encoder.
+ *        CLK and DT are decoded in a pin change interrupt with the full quadrature transition table:
+ *        invalid transitions (bounce, missed edge) count 0, so a detent is never lost or doubled while the
+ *        main loop is busy. A detent is counted when the encoder is back at rest (ENC_REST_STATE) after at least half
+ *        of the ENC_STEP_TRANSITIONS transitions in one direction; the count restarts at every rest state, so a
+ *        missed edge only affects its own detent.
+ *        The detent period is smoothed into a velocity estimate: spinning fast scales the steps (x2, x4),
+ *        so long lists scroll quickly and a slow turn still moves one item per detent.
+ *        The interrupt only adds to the position, the main loop reads it (readSteps()): no lock needed.
+ *        The switch is polled (updateEncoder()).
  * 
  */
 class Encoder{
     private:
         uint8_t _pinCLK, _pinDT, _pinSW, _pprDivider;
-        uint8_t _currentStateCLK, _lastStateCLK, _dir;
+        uint8_t _dir;
         uint8_t _currentStateSW, _lastStateSW;
-        bool _pressed;
-        long _count, _ppr;
+        bool _pressed, _pressedLatch, _longPressLatch, _longPressFired;
+        unsigned long _swPressTime;
+        long _ppr;
+        Pio* _portCLK;
+        Pio* _portDT;
+        uint32_t _maskCLK, _maskDT;
+        volatile uint8_t _state;                // CLK << 1 | DT
+        volatile int8_t _transitions;           // Since the last detent, positive: CW
+        volatile int8_t _lastDetentDir;
+        volatile long _count;                   // Detents, 0 to ppr
+        volatile int32_t _position;             // Accelerated steps, positive: CW. Written by the interrupt only
+        volatile uint32_t _detentTime;
+        volatile uint32_t _detentPeriod;        // Smoothed, us
+        int32_t _readPosition, _pollPosition;
+        void detent(int8_t dir);
 
 
     public:
         Encoder(uint8_t pinCLK, uint8_t pinDT, uint8_t pinSW, long ppr, uint8_t pprDivider);
         void init();
         void updateEncoder();
+        void decode();
         void debug();
         uint8_t getPulses();
         uint8_t getDirection();
         bool isPressed();
         bool isMoving();
+        int16_t readSteps();
+        bool readPressed();
+        bool readLongPressed();
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,146 @@
+#include "HeapWatch.h"
+
+volatile bool HeapWatch::_armed = false;
+volatile uint32_t HeapWatch::_allocations = 0;
+volatile uint32_t HeapWatch::_bytes = 0;
+uint32_t HeapWatch::_armedTop = 0;
+uint32_t HeapWatch::_highWater = 0;
+
+#ifdef ARDUINO_ARCH_SAM
+
+static uint8_t wrapDepth = 0;                       // malloc() calls _malloc_r(): count the outer call only
+
+extern "C" {
+    void* _sbrk(int increment);
+    void* __real_malloc(size_t size);
+    void* __real_realloc(void* ptr, size_t size);
+    void* __real_calloc(size_t n, size_t size);
+    void* __real__malloc_r(struct _reent* r, size_t size);
+    void* __real__realloc_r(struct _reent* r, void* ptr, size_t size);
+    void* __real__calloc_r(struct _reent* r, size_t n, size_t size);
+
+    void* __wrap_malloc(size_t size){
+        wrapDepth++;
+        void* p = __real_malloc(size);
+        wrapDepth--;
+        if(wrapDepth == 0)  HeapWatch::countAllocation(size);
+        return p;
+    }
+
+    void* __wrap_realloc(void* ptr, size_t size){
+        wrapDepth++;
+        void* p = __real_realloc(ptr, size);
+        wrapDepth--;
+        if(wrapDepth == 0)  HeapWatch::countAllocation(size);
+        return p;
+    }
+
+    void* __wrap_calloc(size_t n, size_t size){
+        wrapDepth++;
+        void* p = __real_calloc(n, size);
+        wrapDepth--;
+        if(wrapDepth == 0)  HeapWatch::countAllocation(n * size);
+        return p;
+    }
+
+    // Reentrant versions, called directly by newlib (stdio, printf family, dtoa)
+    void* __wrap__malloc_r(struct _reent* r, size_t size){
+        wrapDepth++;
+        void* p = __real__malloc_r(r, size);
+        wrapDepth--;
+        if(wrapDepth == 0)  HeapWatch::countAllocation(size);
+        return p;
+    }
+
+    void* __wrap__realloc_r(struct _reent* r, void* ptr, size_t size){
+        wrapDepth++;
+        void* p = __real__realloc_r(r, ptr, size);
+        wrapDepth--;
+        if(wrapDepth == 0)  HeapWatch::countAllocation(size);
+        return p;
+    }
+
+    void* __wrap__calloc_r(struct _reent* r, size_t n, size_t size){
+        wrapDepth++;
+        void* p = __real__calloc_r(r, n, size);
+        wrapDepth--;
+        if(wrapDepth == 0)  HeapWatch::countAllocation(n * size);
+        return p;
+    }
+}
+
+static uint32_t heapTop(){
+    return (uint32_t)_sbrk(0);
+}
+
+#else
+
+static uint32_t heapTop(){
+    return 0;                                       // Host heap: only allocations are counted
+}
+
+#endif
+
+/**
+ * @brief End of setup(): from now on every allocation is counted
+ *
+ */
+void HeapWatch::arm(){
+    _allocations = 0;
+    _bytes = 0;
+    _armedTop = heapTop();
+    _highWater = 0;
+    _armed = true;
+}
+
+/**
+ * @brief Count an allocation made after arm() and update the heap high-water mark
+ *
+ * @param size Requested bytes
+ */
+void HeapWatch::countAllocation(size_t size){
+    if(!_armed)     return;
+    _allocations++;
+    _bytes += size;
+    updateHighWater();
+}
+
+/**
+ * @brief Compare the top of the heap with the one saved by arm(). Also called when reading the mark, so heap
+ *        growth shows even if the allocation went around the wrapped functions
+ *
+ */
+void HeapWatch::updateHighWater(){
+    uint32_t top = heapTop();
+    if(_armed && top > _armedTop && top - _armedTop > _highWater)    _highWater = top - _armedTop;
+}
+
+/**
+ * @brief Allocations since the end of setup()
+ *
+ * @return uint32_t 0 if the main loop is allocation-free
+ */
+uint32_t HeapWatch::getAllocations(){
+    return _allocations;
+}
+
+/**
+ * @brief Growth of the heap since the end of setup()
+ *
+ * @return uint32_t bytes (always 0 on the native build)
+ */
+uint32_t HeapWatch::getHighWater(){
+    updateHighWater();
+    return _highWater;
+}
+
+/**
+ * @brief Serial debug. Print allocations and heap growth since the end of setup()
+ *
+ */
+void HeapWatch::serialDebug(){
+    updateHighWater();
+    Serial.print("HEAP allocations after setup: "); Serial.print(_allocations);
+    Serial.print(" bytes: "); Serial.print(_bytes);
+    Serial.print(" high-water: +"); Serial.println(_highWater);
+}
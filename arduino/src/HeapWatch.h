@@ -0,0 +1,32 @@
+#ifndef _HEAP_WATCH_H_
+#define _HEAP_WATCH_H_
+
+#include <Arduino.h>
+
+/**
+ * @brief This class checks that the firmware does not allocate after setup(): the main loop must only use
+ *        static memory and the stack (no String, no new).
+ *        Allocations are reported to countAllocation(): on the Due malloc, realloc, calloc and their newlib
+ *        reentrant versions (_malloc_r..., called directly by stdio and the printf family) are wrapped at link
+ *        time (-Wl,--wrap in platformio.ini), on the native build operator new is replaced
+ *        (native/HeapWatchNative.cpp). arm() at the end of setup() starts counting, and records the top of the
+ *        heap (sbrk). The high-water mark compares sbrk(0) with it, also when read: heap growth shows even
+ *        if an allocation is not counted. 'h' on debug serial prints them.
+ */
+class HeapWatch{
+    private:
+        static volatile bool _armed;
+        static volatile uint32_t _allocations;
+        static volatile uint32_t _bytes;
+        static uint32_t _armedTop, _highWater;
+        static void updateHighWater();
+
+    public:
+        static void arm();
+        static void countAllocation(size_t size);
+        static uint32_t getAllocations();
+        static uint32_t getHighWater();
+        static void serialDebug();
+};
+
+#endif
@@ -0,0 +1,87 @@
+#include "HoldWheel.h"
+
+
+/**
+ * @brief Construct an empty wheel
+ * 
+ * @param tickUs Time of a slot (us). Use the keypad scan interval: timers cannot be more precise than a scan.
+ */
+HoldWheel::HoldWheel(uint32_t tickUs){
+	_tickUs = tickUs;
+	_time = 0;
+	_current = 0;
+	_pending = 0;
+	memset(_slots, 0, sizeof(_slots));
+	memset(_rounds, 0, sizeof(_rounds));
+	memset(_slotOf, 0, sizeof(_slotOf));
+}
+
+
+/**
+ * @brief Start the timer of a key. A pending timer of the same key is replaced.
+ * 		  Call advance() with the same time before, so that the wheel is at the current slot.
+ * 
+ * @param key Key index (0 - HOLD_WHEEL_MAX_KEYS-1)
+ * @param delayUs Time before expiring (us, max 255 revolutions)
+ * @param now micros()
+ */
+void HoldWheel::schedule(uint8_t key, uint32_t delayUs, uint32_t now){
+	cancel(1UL << key);
+	uint32_t ticks = (now - _time + delayUs + _tickUs - 1) / _tickUs;			// From the current slot
+	if(ticks == 0)	ticks = 1;
+	_slotOf[key] = (_current + ticks) & (HOLD_WHEEL_SLOTS - 1);
+	_rounds[key] = (ticks - 1) / HOLD_WHEEL_SLOTS;
+	_slots[_slotOf[key]] |= (1UL << key);
+	_pending |= (1UL << key);
+}
+
+
+/**
+ * @brief Stop the timers of some keys
+ * 
+ * @param keys Bit i set: key i
+ */
+void HoldWheel::cancel(uint32_t keys){
+	for(uint32_t m = keys & _pending; m != 0; m &= m - 1){
+		uint8_t i = __builtin_ctz(m);
+		_slots[_slotOf[i]] &= ~(1UL << i);
+	}
+	_pending &= ~keys;
+}
+
+
+/**
+ * @brief Move the wheel to the current time.
+ * 
+ * @param now micros()
+ * @return uint32_t Keys whose timer expired (bit i: key i)
+ */
+uint32_t HoldWheel::advance(uint32_t now){
+	uint32_t expired = 0;
+	if(_pending == 0){												// Nothing to wait for: just follow the time
+		_time = now;
+		return 0;
+	}
+	while((now - _time) >= _tickUs){
+		_time += _tickUs;
+		_current = (_current + 1) & (HOLD_WHEEL_SLOTS - 1);
+		for(uint32_t m = _slots[_current]; m != 0; m &= m - 1){
+			uint8_t i = __builtin_ctz(m);
+			if(_rounds[i] > 0)	_rounds[i]--;
+			else				expired |= (1UL << i);
+		}
+		_slots[_current] &= ~expired;
+	}
+	_pending &= ~expired;
+	return expired;
+}
+
+
+/**
+ * @brief Keys with a running timer
+ * 
+ * @return uint32_t bit i: key i
+ */
+uint32_t HoldWheel::getPending(){
+	return _pending;
+}
@@ -0,0 +1,34 @@
+#ifndef _HOLD_WHEEL_H_
+#define _HOLD_WHEEL_H_
+
+#include <Arduino.h>
+
+#define HOLD_WHEEL_SLOTS 32			// Power of 2. One revolution: HOLD_WHEEL_SLOTS ticks
+#define HOLD_WHEEL_MAX_KEYS 32		// One bit per key in a 32 bit word
+
+/**
+ * @brief Hashed timer wheel of the key hold timers of a keypad.
+ * 		  A timer is a key bit in the slot where it expires, plus the number of wheel revolutions still to wait.
+ * 		  Scheduling and cancelling cost a few operations, and advancing the wheel only looks at the keys of
+ * 		  the slots it passes: time is not checked key by key. An empty wheel is not advanced at all.
+ * 
+ */
+class HoldWheel {
+	private:
+		uint32_t _slots[HOLD_WHEEL_SLOTS];				// Bit i: key i expires in this slot
+		uint8_t _rounds[HOLD_WHEEL_MAX_KEYS];			// Revolutions to wait before expiring
+		uint8_t _slotOf[HOLD_WHEEL_MAX_KEYS];
+		uint32_t _pending;								// Keys with a timer
+		uint32_t _tickUs;
+		uint32_t _time;									// micros() of the current slot
+		uint8_t _current;
+
+	public:
+		HoldWheel(uint32_t tickUs);
+		void schedule(uint8_t key, uint32_t delayUs, uint32_t now);
+		void cancel(uint32_t keys);
+		uint32_t advance(uint32_t now);
+		uint32_t getPending();
+};
+
+#endif
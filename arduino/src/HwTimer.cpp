@@ -0,0 +1,77 @@
+#include "HwTimer.h"
+
+#ifdef ARDUINO_ARCH_SAM
+
+typedef struct {
+    Tc* tc;
+    uint32_t channel;
+    IRQn_Type irq;
+} HwTimerChannel;
+
+static const HwTimerChannel _channels[HW_TIMER_CHANNELS] = {
+    {TC0, 0, TC0_IRQn}, {TC0, 1, TC1_IRQn}, {TC0, 2, TC2_IRQn},
+    {TC1, 0, TC3_IRQn}, {TC1, 1, TC4_IRQn}, {TC1, 2, TC5_IRQn},
+    {TC2, 0, TC6_IRQn}, {TC2, 1, TC7_IRQn}, {TC2, 2, TC8_IRQn}
+};
+
+static volatile HwTimerCallback _callbacks[HW_TIMER_CHANNELS];
+
+/**
+ * @brief Construct a new HwTimer
+ *
+ * @param channel Timer Counter channel (0-8). Channel n uses TCn_Handler interrupt
+ */
+HwTimer::HwTimer(uint8_t channel){
+    _channel = channel;
+}
+
+/**
+ * @brief Start the timer. The callback is called every period from the timer interrupt.
+ *        Timer clock is MCK/2 (42 MHz).
+ *
+ * @param periodUs Period in microseconds
+ * @param callback Function called by the interrupt
+ * @param priority NVIC priority (0: highest, 15: lowest)
+ */
+void HwTimer::start(uint32_t periodUs, HwTimerCallback callback, uint8_t priority){
+    const HwTimerChannel* ch = &_channels[_channel];
+    _callbacks[_channel] = callback;
+    pmc_set_writeprotect(false);
+    pmc_enable_periph_clk((uint32_t)ch->irq);
+    TC_Configure(ch->tc, ch->channel, TC_CMR_WAVE | TC_CMR_WAVSEL_UP_RC | TC_CMR_TCCLKS_TIMER_CLOCK1);
+    TC_SetRC(ch->tc, ch->channel, (VARIANT_MCK / 2 / 1000000) * periodUs);
+    ch->tc->TC_CHANNEL[ch->channel].TC_IER = TC_IER_CPCS;      // Interrupt on RC compare
+    ch->tc->TC_CHANNEL[ch->channel].TC_IDR = ~TC_IER_CPCS;
+    NVIC_ClearPendingIRQ(ch->irq);
+    NVIC_SetPriority(ch->irq, priority);
+    NVIC_EnableIRQ(ch->irq);
+    TC_Start(ch->tc, ch->channel);
+}
+
+/**
+ * @brief Stop the timer and disable its interrupt
+ *
+ */
+void HwTimer::stop(){
+    const HwTimerChannel* ch = &_channels[_channel];
+    NVIC_DisableIRQ(ch->irq);
+    TC_Stop(ch->tc, ch->channel);
+}
+
+
+static inline void handleInterrupt(uint8_t channel){
+    TC_GetStatus(_channels[channel].tc, _channels[channel].channel);    // Clear interrupt flag
+    if(_callbacks[channel] != NULL)  _callbacks[channel]();
+}
+
+void TC0_Handler(){ handleInterrupt(0); }
+void TC1_Handler(){ handleInterrupt(1); }
+void TC2_Handler(){ handleInterrupt(2); }
+void TC3_Handler(){ handleInterrupt(3); }
+void TC4_Handler(){ handleInterrupt(4); }
+void TC5_Handler(){ handleInterrupt(5); }
+void TC6_Handler(){ handleInterrupt(6); }
+void TC7_Handler(){ handleInterrupt(7); }
+void TC8_Handler(){ handleInterrupt(8); }
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef _HW_TIMER_H_
+#define _HW_TIMER_H_
+
+#include <Arduino.h>
+
+#define HW_TIMER_CHANNELS         9
+#define HW_TIMER_DEFAULT_PRIORITY 15        // Lowest NVIC priority: serial and ADC interrupts preempt the callback. SysTick is
+                                            // also 15 on the Due core: a tick waits for the callback (no tick lost below 1 ms)
+
+typedef void (*HwTimerCallback)();
+
+/**
+ * @brief This class control a SAM3X Timer Counter channel (TC0..TC8) as a periodic interrupt.
+ *        The callback runs in interrupt context: keep it short and don't use Serial.
+ *        In the native build the HAL clock fires the callback (native/HwTimerNative.cpp).
+ *
+ */
+class HwTimer{
+    private:
+        uint8_t _channel;
+
+    public:
+        HwTimer(uint8_t channel);
+        void start(uint32_t periodUs, HwTimerCallback callback, uint8_t priority = HW_TIMER_DEFAULT_PRIORITY);
+        void stop();
+};
+
+#endif
@@ -14,7 +14,11 @@ Copyright (c) 2015  Marek Buriak
 // comment out the SPI mode you want to use (does not matter for AVR)
 //#define ILI9341_SPI_MODE_NORMAL	// uses SPI library
 //#define ILI9341_SPI_MODE_EXTENDED	// uses Extended SPI in Due, make sure you use pin 4, 10 or 52 for CS
+#ifdef NATIVE_HAL
+#define ILI9341_SPI_MODE_NORMAL		// native build: SPI simulated by the HAL
+#else
 #define ILI9341_SPI_MODE_DMA		// uses DMA in Due
+#endif
 
 // set the clock divider
 #if defined ARDUINO_SAM_DUE
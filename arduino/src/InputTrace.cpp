@@ -0,0 +1,106 @@
+#include "InputTrace.h"
+
+#ifdef TRACE_ENABLED
+
+RingBuffer<TraceRecord, TRACE_QUEUE_SIZE> InputTrace::_queue;
+uint32_t InputTrace::_sources[TRACE_SOURCES];
+uint16_t InputTrace::_lastValues[TRACE_SOURCES];
+uint8_t InputTrace::_nSources = 0;
+volatile bool InputTrace::_running = false;
+uint16_t InputTrace::_droppedAtStart = 0;
+
+// Records come from the main loop and from the keypad scan interrupt: the queue has more than one producer
+#ifdef ARDUINO_ARCH_SAM
+#define TRACE_LOCK()    uint32_t primask = __get_PRIMASK(); __disable_irq()
+#define TRACE_UNLOCK()  __set_PRIMASK(primask)
+#else
+#define TRACE_LOCK()
+#define TRACE_UNLOCK()
+#endif
+
+/**
+ * @brief Send the stream header and start recording. Every input is recorded at its first read.
+ *
+ */
+void InputTrace::start(){
+    uint8_t header[6] = {TRACE_MAGIC[0], TRACE_MAGIC[1], TRACE_MAGIC[2], TRACE_MAGIC[3], TRACE_VERSION, TRACE_ANALOG_BITS};
+    TraceRecord r;
+    _running = false;
+    while(_queue.pop(r));                                   // Discard records of a previous trace not yet sent
+    _nSources = 0;
+    _droppedAtStart = _queue.getDropped();
+    Serial.write(header, sizeof(header));
+    _running = true;
+}
+
+/**
+ * @brief Stop recording. The end record is sent by the next flush() calls, after the queued records.
+ *
+ */
+void InputTrace::stop(){
+    if(!_running)  return;
+    _running = false;
+    TraceRecord r = {(uint32_t)micros(), TRACE_REC_END, 0, 0, (uint16_t)(_queue.getDropped() - _droppedAtStart)};
+    TRACE_LOCK();
+    _queue.push(r);
+    TRACE_UNLOCK();
+}
+
+bool InputTrace::isRunning(){
+    return _running;
+}
+
+/**
+ * @brief Queue a record if the input value changed since the last record of the same input.
+ *        Bytes from the Raspberry are always queued.
+ *
+ * @param type TraceRecordType
+ * @param pin Digital/analog/row pin
+ * @param channel Mux channel or column pin
+ * @param value Read value
+ */
+void InputTrace::record(uint8_t type, uint8_t pin, uint8_t channel, uint16_t value){
+    if(!_running)  return;
+    uint32_t source = ((uint32_t)type << 16) | ((uint32_t)pin << 8) | channel;
+    TraceRecord r = {(uint32_t)micros(), type, pin, channel, value};
+    TRACE_LOCK();
+    if(type != TRACE_REC_SERIAL){
+        uint8_t i = 0;
+        while(i < _nSources && _sources[i] != source)  i++;
+        if(i == _nSources && _nSources < TRACE_SOURCES){                    // First read of this input
+            _sources[i] = source;
+            _lastValues[i] = TRACE_NO_VALUE;
+            _nSources++;
+        }
+        if(i < _nSources){
+            if(_lastValues[i] != value)  _lastValues[i] = _queue.push(r) ? value : TRACE_NO_VALUE;   // If dropped, the next read is recorded again
+            TRACE_UNLOCK();
+            return;
+        }
+    }
+    _queue.push(r);                                                         // Serial byte, or too many inputs to track changes
+    TRACE_UNLOCK();
+}
+
+/**
+ * @brief Send queued records on debug serial, without blocking when its TX buffer is full.
+ *        Call it from the main loop.
+ */
+void InputTrace::flush(){
+    TraceRecord r;
+    while(_queue.available() > 0 && Serial.availableForWrite() >= TRACE_RECORD_SIZE){
+        if(_queue.pop(r))  write(r);
+    }
+}
+
+/**
+ * @brief Send a record (little endian)
+ *
+ */
+void InputTrace::write(const TraceRecord& r){
+    uint8_t buf[TRACE_RECORD_SIZE] = {(uint8_t)r.time, (uint8_t)(r.time >> 8), (uint8_t)(r.time >> 16), (uint8_t)(r.time >> 24),
+                                      r.type, r.pin, r.channel, (uint8_t)r.value, (uint8_t)(r.value >> 8)};
+    Serial.write(buf, sizeof(buf));
+}
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef _INPUT_TRACE_H_
+#define _INPUT_TRACE_H_
+
+#include <Arduino.h>
+#include "RingBuffer.h"
+
+typedef enum {TRACE_REC_DIGITAL, TRACE_REC_MATRIX, TRACE_REC_ANALOG, TRACE_REC_SERIAL, TRACE_REC_END} TraceRecordType;
+
+#define TRACE_MAGIC             "PLTR"
+#define TRACE_VERSION           1
+#define TRACE_ANALOG_BITS       12          // ADC resolution of the traced values
+#define TRACE_NO_CHANNEL        255         // Analog record of a pin without mux
+#define TRACE_RECORD_SIZE       9           // Bytes of a record on the wire
+#define TRACE_QUEUE_SIZE        128
+#define TRACE_SOURCES           64          // Max number of inputs whose last value is kept
+#define TRACE_NO_VALUE          0xFFFF      // Last value of an input not recorded yet
+
+typedef struct {
+    uint32_t time;
+    uint8_t type, pin, channel;
+    uint16_t value;
+} TraceRecord;
+
+/**
+ * @brief Record the raw inputs seen by the firmware, to replay them on the host (see replay/replay.cpp).
+ *        TRACE_*() macros are placed where inputs are read. Pins and analog values are recorded only when they
+ *        change (the first read after start() is always recorded), bytes from the Raspberry are always recorded.
+ *        Build with -D TRACE_ENABLED to enable it, otherwise the macros are empty and nothing is compiled.
+ *
+ *        Stream sent on debug serial (SR0) by flush(), little endian:
+ *          header: "PLTR", version, analog bits
+ *          record: time (uint32 us), type, pin, channel, value (uint16)
+ *              TRACE_REC_DIGITAL   pin: digital pin      value: pin level
+ *              TRACE_REC_MATRIX    pin: row pin          channel: column pin       value: 1 if key pressed
+ *              TRACE_REC_ANALOG    pin: analog pin       channel: mux channel      value: analogRead()
+ *              TRACE_REC_SERIAL    value: byte received from the Raspberry
+ *              TRACE_REC_END       value: number of dropped records (last record of the stream)
+ */
+#ifdef TRACE_ENABLED
+
+#define TRACE_DIGITAL(pin, value)             InputTrace::record(TRACE_REC_DIGITAL, pin, 0, value)
+#define TRACE_MATRIX(rowPin, colPin, pressed) InputTrace::record(TRACE_REC_MATRIX, rowPin, colPin, pressed)
+#define TRACE_ANALOG(pin, channel, value)     InputTrace::record(TRACE_REC_ANALOG, pin, channel, value)
+#define TRACE_SERIAL(c)                       InputTrace::record(TRACE_REC_SERIAL, 0, 0, c)
+
+/**
+ * @brief This class queue the trace records in RAM and send them on the debug serial from the main loop.
+ *        Records can be added from interrupts (keypad scan).
+ */
+class InputTrace{
+    private:
+        static RingBuffer<TraceRecord, TRACE_QUEUE_SIZE> _queue;
+        static uint32_t _sources[TRACE_SOURCES];            // type, pin and channel of an input
+        static uint16_t _lastValues[TRACE_SOURCES];
+        static uint8_t _nSources;
+        static volatile bool _running;
+        static uint16_t _droppedAtStart;
+        static void write(const TraceRecord& r);
+
+    public:
+        static void start();
+        static void stop();
+        static bool isRunning();
+        static void record(uint8_t type, uint8_t pin, uint8_t channel, uint16_t value);
+        static void flush();
+};
+
+#else
+
+#define TRACE_DIGITAL(pin, value)
+#define TRACE_MATRIX(rowPin, colPin, pressed)
+#define TRACE_ANALOG(pin, channel, value)
+#define TRACE_SERIAL(c)
+
+#endif
+
+#endif
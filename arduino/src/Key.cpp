@@ -47,6 +47,7 @@ bool Key::update(uint8_t pinToRead){
 				newState = RELEASED;
 			break;
 		case HOLD:
+		case LONG_HOLD:
 			if (actualValue == RELEASED)
 				newState = RELEASED;
 			break;
@@ -62,7 +63,7 @@ bool Key::update(uint8_t pinToRead){
  * @param k Selected key
  */
 void Key::serialDebug(){
-    String msg = "IDLE";
+    const char* msg = "IDLE";
     Serial.print("Button ID: "); Serial.print( id);
     Serial.print(" state: "); 
     switch(state){
@@ -75,6 +76,9 @@ void Key::serialDebug(){
         case HOLD:  
             msg = "HOLD"; 
             break;
+        case LONG_HOLD:  
+            msg = "LONG_HOLD"; 
+            break;
     }
     Serial.print(msg);
     Serial.print(" state changed: "); Serial.print( stateChanged);
@@ -4,11 +4,14 @@
 
 #include <Arduino.h>
 
-typedef enum{ RELEASED, PRESSED, HOLD } KeyState;
+typedef enum{ RELEASED, PRESSED, HOLD, LONG_HOLD } KeyState;
 
 const uint8_t NO_KEY = 255;
 const uint8_t NO_LED = 255;
 const uint16_t HOLD_TIME = 500;
+const uint16_t LONG_HOLD_TIME = 2000;
+const uint8_t HOLD_STAGES = 2;											// Keypad keys: HOLD, then LONG_HOLD
+const uint16_t HOLD_STAGE_TIME[HOLD_STAGES] = {HOLD_TIME, LONG_HOLD_TIME};	// ms from the press
 
 /**
  * @brief This class control a single key (button)
@@ -2,98 +2,221 @@
 
 
 /**
- * @brief Construct a new Keypad
+ * @brief Construct the size independent part of a keypad
  * 
- * @param idKey Array of all buttons IDs
- * @param idLed Array of all leds IDs.  
- * @param rowPins Array of all pins connected to the rows of the matrix
- * @param colPins Array of all pins connected to the colums of the matrix
+ * @param keyStorage Array of numRows * numCols keys, owned by the Keypad<ROWS, COLS>
  * @param numRows Number of rows in the matrix
  * @param numCols Number of columns in the matrix
  */
-Keypad::Keypad(uint8_t *idKey, uint8_t *idLed, uint8_t *rowPins, uint8_t *colPins, uint8_t numRows, uint8_t numCols){
-	_rowPins = rowPins;
-	_colPins = colPins;
+KeypadBase::KeypadBase(Key* keyStorage, uint8_t numRows, uint8_t numCols) : _holdWheel(KEYPAD_SCAN_INTERVAL){
+	keys = keyStorage;
 	_nRows = numRows;
 	_nCols = numCols;
-	_idKey = idKey;
-	_idLed = idLed;
 	_scanTime = 0;
-	keys = (Key*) realloc(keys,(_nRows * _nCols) * sizeof(Key));
+	_lastScanUs = 0;
+	_maxScanGapUs = 0;
+	_debounced = 0;
+	_cnt0 = 0;
+	_cnt1 = 0;
+	memset(_holdStage, 0, sizeof(_holdStage));
+	_pressedEdges = 0;
+	_releasedEdges = 0;
+	_holdEdges = 0;
 }
 
 
-
 /**
- * @brief Initialize keypad object.
- * 	      Initialize rows as OUTPUT and columns as INPUT_PULLUP.
- * 		  Initialize key object.
+ * @brief Scan keys every KEYPAD_SCAN_INTERVAL us.
+ * 		  Return true if any key changed state.
  * 
+ * @return bool
  */
-void Keypad::init(){
-	for (uint8_t r=0; r<_nRows; r++) {
-		pinMode(_rowPins[r],OUTPUT);
-	}
-	for (uint8_t c=0; c<_nCols; c++) {
-		pinMode(_colPins[c],INPUT_PULLUP);
-	}
-	for(uint8_t i=0; i<(_nRows * _nCols); i++){				//Initialize array of all keys
-		keys[i]=Key(_idKey[i], NO_KEY, _idLed[i]);
+bool KeypadBase::getKeys() {
+	bool keyActivity = false;
+	if ( (micros() - _scanTime) >= KEYPAD_SCAN_INTERVAL ) { 	// Limit how often the keypad is scanned. 
+		keyActivity = scanKeys();
+		_scanTime = micros();
 	}
+	return keyActivity;
 }
 
+/**
+ * @brief Timestamp the scan and keep track of the worst time between two scans. Called at the beginning of every scan.
+ * 
+ */
+void KeypadBase::startScan(){
+	uint32_t now = micros();
+	if(_lastScanUs != 0 && (now - _lastScanUs) > _maxScanGapUs)	_maxScanGapUs = now - _lastScanUs;
+	_lastScanUs = now;
+}
 
+#ifdef ARDUINO_ARCH_SAM
 /**
- * @brief Scan keys every DEBOUNCE_TIME ms.
- * 		  Return true if any of these are pressed.
+ * @brief Busy-wait for matrix lines to settle. Counts SysTick (MCK, reloaded every ms) so it works
+ * 		  in the scan interrupt, where the SysTick handler cannot run.
  * 
- * @return bool
+ * @param us Time to wait
  */
-bool Keypad::getKeys() {
-	bool keyActivity = false;
-	if ( (millis() - _scanTime) > DEBOUNCE_TIME ) { 	// Limit how often the keypad is scanned. 
-		keyActivity = scanKeys();
-		_scanTime = millis();
+void KeypadBase::settle(uint32_t us){
+	uint32_t ticks = us * (VARIANT_MCK / 1000000);
+	uint32_t load = SysTick->LOAD + 1;
+	uint32_t last = SysTick->VAL, elapsed = 0;
+	while(elapsed < ticks){
+		uint32_t now = SysTick->VAL;
+		elapsed += (last >= now) ? last - now : last + load - now;		// Down counter
+		last = now;
 	}
-	return keyActivity;
 }
+#endif
+
 
 /**
- * @brief Scan keys of the matrix. Update status of each key.
+ * @brief Debounce the samples of a scan.
+ * 		  A key changes state after DEBOUNCE_SAMPLES consecutive scans with the same new value:
+ * 		  every key has a 2 bit counter, stored as bit i of _cnt0 (low bit) and _cnt1 (high bit),
+ * 		  so all counters are updated with a few bitwise operations.
+ * 		  A press starts the hold timer of the key, a release cancels it. When it expires the key reaches
+ * 		  the next hold stage (HOLD, LONG_HOLD) and the timer of the following stage is started.
+ * 		  Time is only checked by the wheel, once per scan and only while a timer is running.
  * 
+ * @param raw Bit i set: key i is closed
+ * @return bool true if any key changed state
  */
-bool Keypad::scanKeys() {
-	uint8_t idx = 0;
-	bool anyActivity = false, activity = false;
-	for (uint8_t r=0; r<_nRows; r++ ) {
-		digitalWrite(_rowPins[r], LOW);							// Begin row pulse output.
-		for (uint8_t c=0; c<_nCols; c++) {
-			activity = keys[idx].update(_colPins[c]);  			// Change Key staus. Keypress is active low so invert to high.
-			if(activity)	anyActivity = true;
-			idx++;
-		}
-		digitalWrite(_rowPins[r], HIGH);						// Set pin to high impedance input. Effectively ends row pulse.
+bool KeypadBase::debounce(uint32_t raw) {
+	// Vertical counters: count samples different from the debounced state, reset the others
+	uint32_t delta = raw ^ _debounced;
+	_cnt1 = (_cnt1 ^ _cnt0) & delta;
+	_cnt0 = ~_cnt0 & delta;
+	uint32_t toggle = delta & ~(_cnt0 | _cnt1);					// Counter wrapped: DEBOUNCE_SAMPLES different samples
+	_debounced ^= toggle;
+	_pressedEdges = toggle & _debounced;
+	_releasedEdges = toggle & ~_debounced;
+
+	// Hold stages
+	_holdWheel.cancel(_releasedEdges);
+	_holdEdges = _holdWheel.advance(_lastScanUs);
+	for(uint32_t m = _holdEdges; m != 0; m &= m - 1){
+		uint8_t i = __builtin_ctz(m);
+		uint8_t stage = _holdStage[i]++;
+		if(stage + 1 < HOLD_STAGES)	_holdWheel.schedule(i, (HOLD_STAGE_TIME[stage + 1] - HOLD_STAGE_TIME[stage]) * 1000UL, _lastScanUs);
+	}
+	for(uint32_t m = _pressedEdges; m != 0; m &= m - 1){
+		uint8_t i = __builtin_ctz(m);
+		_holdStage[i] = 0;
+		_holdWheel.schedule(i, HOLD_STAGE_TIME[0] * 1000UL, _lastScanUs);
 	}
-	return anyActivity;
+	return (toggle | _holdEdges) != 0;
 }
 
 
 
+/**
+ * @brief Push a KeyEvent for every key changed in the last scan, and update the state of those keys only.
+ * 		  Work depends on the number of changed keys, not on the keypad size.
+ * 		  Can be called from an interrupt, right after scanKeys().
+ * 
+ * @param queue Event queue
+ * @param source Keypad identifier copied in the events
+ * @return uint8_t Number of pushed events
+ */
+uint8_t KeypadBase::pushEvents(KeyEventQueue* queue, uint8_t source){
+	uint8_t n = 0;
+	KeyEvent e;
+	e.timestamp = _lastScanUs;
+	e.source = source;
+	for(uint32_t m = _pressedEdges | _releasedEdges | _holdEdges; m != 0; m &= m - 1){
+		uint8_t i = __builtin_ctz(m);
+		if(_releasedEdges & (1UL << i))		keys[i].state = RELEASED;
+		else if(_holdEdges & (1UL << i))	keys[i].state = (KeyState)(HOLD + _holdStage[i] - 1);
+		else								keys[i].state = PRESSED;
+		e.index = i;
+		e.id = keys[i].id;
+		e.edge = keys[i].state;
+		if(queue->push(e))	n++;
+	}
+	return n;
+}
+
 /**
  * @brief Return number of keys
  * 
  * @return int columns*rows
  */
-int Keypad::getNumberKeys(){
+int KeypadBase::getNumberKeys(){
 	return _nCols * _nRows;
 }
 
 
-uint8_t Keypad::getNumbersRows(){
+/**
+ * @brief Time of the last scan, the timestamp of its key events
+ * 
+ * @return uint32_t micros()
+ */
+uint32_t KeypadBase::getLastScanTime(){
+	return _lastScanUs;
+}
+
+
+/**
+ * @brief Return the worst time between two consecutive scanKeys() calls
+ * 
+ * @return uint32_t microseconds
+ */
+uint32_t KeypadBase::getMaxScanGap(){
+	return _maxScanGapUs;
+}
+
+
+void KeypadBase::resetScanGap(){
+	_maxScanGapUs = 0;
+}
+
+
+/**
+ * @brief Debounced state of all keys
+ * 
+ * @return uint32_t bit i set: key i is pressed (or held)
+ */
+uint32_t KeypadBase::getPressed(){
+	return _debounced;
+}
+
+
+/**
+ * @brief Keys pressed in the last scan
+ * 
+ * @return uint32_t bit i: key i
+ */
+uint32_t KeypadBase::getPressedEdges(){
+	return _pressedEdges;
+}
+
+
+/**
+ * @brief Keys released in the last scan
+ * 
+ * @return uint32_t bit i: key i
+ */
+uint32_t KeypadBase::getReleasedEdges(){
+	return _releasedEdges;
+}
+
+
+/**
+ * @brief Keys that reached a hold stage (HOLD or LONG_HOLD) in the last scan
+ * 
+ * @return uint32_t bit i: key i
+ */
+uint32_t KeypadBase::getHoldEdges(){
+	return _holdEdges;
+}
+
+
+uint8_t KeypadBase::getNumbersRows(){
 	return _nRows;
 }
 
 
-uint8_t Keypad::getNumberColumns(){
+uint8_t KeypadBase::getNumberColumns(){
 	return _nCols;
 }
\ No newline at end of file
@@ -2,8 +2,32 @@
 #define _KEYPAD_H_
 
 #include "Key.h"
+#include "RingBuffer.h"
+#include "HoldWheel.h"
+#include "InputTrace.h"
 
 #define DEBOUNCE_TIME 	10 // Not less than 1 ms
+#define DEBOUNCE_SAMPLES 4	// Equal consecutive samples to change a key state (2 bit vertical counters)
+#define KEYPAD_SCAN_INTERVAL (DEBOUNCE_TIME * 1000UL / DEBOUNCE_SAMPLES)	// us
+#define KEYPAD_MAX_KEYS 32	// One bit per key in a 32 bit word
+#define KEY_EVENT_QUEUE_SIZE 32
+#define KEYPAD_ROW_SETTLE_TIME 1		// us between driving a row LOW and reading the columns (switch and input synchronizer)
+#define KEYPAD_RELEASE_SETTLE_TIME 8	// us after releasing a row: columns go back HIGH through the weak pull-ups (~100 kOhm)
+
+/**
+ * @brief Key state change produced by a keypad scan (8 bytes).
+ * 		  Only changed keys produce an event: consumers never walk the whole keypad.
+ * 
+ */
+typedef struct {
+	uint32_t timestamp;	// micros() at the beginning of the scan that detected the change
+	uint8_t source;		// Keypad that produced the event (assigned by the caller of pushEvents)
+	uint8_t index;		// Key position in the keypad
+	uint8_t id;
+	uint8_t edge;		// New KeyState of the key: PRESSED, RELEASED, HOLD or LONG_HOLD
+} KeyEvent;
+
+typedef RingBuffer<KeyEvent, KEY_EVENT_QUEUE_SIZE> KeyEventQueue;
 
 // bperrybap - Thanks for a well reasoned argument and the following macro(s).
 // See http://arduino.cc/forum/index.php/topic,142041.msg1069480.html#msg1069480
@@ -22,28 +46,146 @@ do {							 \
 #endif
 
 /**
- * @brief This class control a button matrix.
+ * @brief Pins and ids of a key matrix, known at compile time (constexpr objects are kept in flash).
+ * 
+ * @tparam ROWS Number of rows
+ * @tparam COLS Number of columns
+ */
+template <uint8_t ROWS, uint8_t COLS>
+struct KeypadConfig{
+	uint8_t rowPins[ROWS];				// Pins connected to the rows of the matrix
+	uint8_t colPins[COLS];				// Pins connected to the columns of the matrix
+	uint8_t keyIds[ROWS * COLS];		// Key id of each position. Start from (0,0) ... (0,1)
+	uint8_t ledIds[ROWS * COLS];		// Led id of each position
+};
+
+/**
+ * @brief Part of a button matrix that does not depend on its size (max KEYPAD_MAX_KEYS keys).
+ * 		  Key samples of a scan are packed in a 32 bit word (bit i: key i) and all keys are debounced
+ * 		  at once with vertical counters. Key changes come out as PRESSED/RELEASED/HOLD bitmasks.
+ * 		  Hold stages (HOLD_STAGE_TIME) are timers of a HoldWheel, started by a press and cancelled by a release.
+ * 		  Keys and hold timers are stored by the Keypad<ROWS, COLS> that reads the matrix.
  * 
  */
-class Keypad : public Key {
+class KeypadBase {
 	public:
 		Key *keys;
-		Keypad(uint8_t *idKeyMap, uint8_t *idLedMap, uint8_t *row, uint8_t *col, uint8_t numRows, uint8_t numCols);
-		void init();
+		KeypadBase(Key* keyStorage, uint8_t numRows, uint8_t numCols);
+		virtual void init() = 0;
+		virtual bool scanKeys() = 0;
 		bool getKeys();
 		int getNumberKeys();
-		bool scanKeys();
+		uint8_t pushEvents(KeyEventQueue* queue, uint8_t source);
 		uint8_t getNumbersRows();
 		uint8_t getNumberColumns();
+		uint32_t getLastScanTime();
+		uint32_t getMaxScanGap();
+		void resetScanGap();
+		uint32_t getPressed();
+		uint32_t getPressedEdges();
+		uint32_t getReleasedEdges();
+		uint32_t getHoldEdges();
 
+	protected:
+		void startScan();
+		bool debounce(uint32_t raw);
+		static void settle(uint32_t us);
 
 	private:
-		uint8_t *_idKey, *_idLed;
-		uint8_t *_rowPins, *_colPins;
 		uint8_t _nCols, _nRows;	
 		unsigned long _scanTime;
-	
+		uint32_t _debounced, _cnt0, _cnt1;					// Debounced state and vertical counters. Bit i: key i
+		uint32_t _pressedEdges, _releasedEdges, _holdEdges;	// Changes of the last scan
+		HoldWheel _holdWheel;								// Timer of the next hold stage of each pressed key
+		uint8_t _holdStage[KEYPAD_MAX_KEYS];				// Hold stages reached since the press
+		volatile uint32_t _lastScanUs, _maxScanGapUs;		// Worst time between two scans
 };
 
-#endif
+/**
+ * @brief This class control a button matrix whose size and pins are known at compile time.
+ * 		  Keys are stored in the object (no heap), and the scan loops have constant bounds.
+ * 		  Rows and columns are accessed through the PIO registers: one write drives a row, one read
+ * 		  per port gets all the columns.
+ * 
+ * @tparam ROWS Number of rows
+ * @tparam COLS Number of columns
+ */
+template <uint8_t ROWS, uint8_t COLS>
+class Keypad : public KeypadBase {
+	static_assert(ROWS * COLS <= KEYPAD_MAX_KEYS, "Keypad: too many keys");
+
+	private:
+		const KeypadConfig<ROWS, COLS>& _config;
+		Key _keys[ROWS * COLS];
+
+		// Pins resolved to PIO ports and bit masks by init()
+		Pio* _rowPorts[ROWS];
+		uint32_t _rowMasks[ROWS];
+		Pio* _colPorts[COLS];								// Ports with at least one column
+		uint8_t _nColPorts;
+		uint8_t _colPortIdx[COLS];							// Index in _colPorts of each column
+		uint32_t _colMasks[COLS];
 
+	public:
+		/**
+		 * @brief Construct a new Keypad
+		 * 
+		 * @param config Pins and ids. Must outlive the keypad (use a global constexpr object)
+		 */
+		Keypad(const KeypadConfig<ROWS, COLS>& config) : KeypadBase(_keys, ROWS, COLS), _config(config) {}
+		Keypad(const Keypad&) = delete;
+
+		/**
+		 * @brief Initialize keypad object.
+		 * 	      Initialize rows as OUTPUT (HIGH) and columns as INPUT_PULLUP.
+		 * 		  Resolve row and column pins to PIO ports and bit masks.
+		 * 		  Initialize key object.
+		 * 
+		 */
+		void init() override {
+			for (uint8_t r=0; r<ROWS; r++) {
+				pinMode(_config.rowPins[r], OUTPUT);
+				digitalWrite(_config.rowPins[r], HIGH);
+				_rowPorts[r] = digitalPinToPort(_config.rowPins[r]);
+				_rowMasks[r] = digitalPinToBitMask(_config.rowPins[r]);
+			}
+			_nColPorts = 0;
+			for (uint8_t c=0; c<COLS; c++) {
+				pinMode(_config.colPins[c], INPUT_PULLUP);
+				Pio* port = digitalPinToPort(_config.colPins[c]);
+				uint8_t p = 0;
+				while(p < _nColPorts && _colPorts[p] != port)	p++;
+				if(p == _nColPorts)		_colPorts[_nColPorts++] = port;
+				_colPortIdx[c] = p;
+				_colMasks[c] = digitalPinToBitMask(_config.colPins[c]);
+			}
+			for(uint8_t i=0; i<(ROWS * COLS); i++){				//Initialize array of all keys
+				_keys[i] = Key(_config.keyIds[i], NO_KEY, _config.ledIds[i]);
+			}
+		}
+
+		/**
+		 * @brief Scan keys of the matrix and debounce them (see KeypadBase::debounce).
+		 * 
+		 * @return bool true if any key changed state
+		 */
+		bool scanKeys() override {
+			uint32_t raw = 0;
+			uint32_t pdsr[COLS];
+			startScan();
+			for (uint8_t r=0; r<ROWS; r++ ) {
+				_rowPorts[r]->PIO_CODR = _rowMasks[r];			// Begin row pulse output.
+				settle(KEYPAD_ROW_SETTLE_TIME);
+				for (uint8_t p=0; p<_nColPorts; p++)	pdsr[p] = _colPorts[p]->PIO_PDSR;
+				_rowPorts[r]->PIO_SODR = _rowMasks[r];			// End row pulse. Columns pulled LOW by this row only recover through
+				if(r < ROWS - 1)	settle(KEYPAD_RELEASE_SETTLE_TIME);	// the pull-ups: wait, or the next row sees a ghost press.
+				for (uint8_t c=0; c<COLS; c++) {
+					if(!(pdsr[_colPortIdx[c]] & _colMasks[c]))	raw |= (1UL << (r * COLS + c));		// Keypress is active low
+					TRACE_MATRIX(_config.rowPins[r], _config.colPins[c], (raw >> (r * COLS + c)) & 1);
+				}
+			}
+			return debounce(raw);
+		}
+};
+
+#endif
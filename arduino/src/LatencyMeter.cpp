@@ -0,0 +1,120 @@
+#include "LatencyMeter.h"
+
+/**
+ * @brief Construct a new LatencyMeter. Measure is disabled.
+ *
+ */
+LatencyMeter::LatencyMeter(){
+    _enabled = false;
+    _sequence = 0;
+    reset();
+}
+
+/**
+ * @brief Enable/disable the measure. When disabled BTN_PRESSED messages carry value 0 as before.
+ *
+ * @param enabled
+ */
+void LatencyMeter::setEnabled(bool enabled){
+    _enabled = enabled;
+    _changed = true;
+}
+
+bool LatencyMeter::isEnabled(){
+    return _enabled;
+}
+
+/**
+ * @brief Clear samples and pending measures
+ *
+ */
+void LatencyMeter::reset(){
+    memset(_sentTime, 0, sizeof(_sentTime));
+    _nSamples = 0;
+    _nextSample = 0;
+    _lost = 0;
+    _changed = true;
+}
+
+/**
+ * @brief Start a measure. Call it when a BTN_PRESSED message is sent.
+ *
+ * @return uint8_t Sequence number to send in the message (1-99), 0 if the measure is disabled
+ */
+uint8_t LatencyMeter::startMeasure(){
+    if(!_enabled)  return 0;
+    _sequence = (_sequence % (LATENCY_SEQUENCES - 1)) + 1;
+    if(_sentTime[_sequence] != 0)  _lost++;                             // Echo never received
+    _sentTime[_sequence] = micros() | 1;                                // 0 is kept for "not pending"
+    return _sequence;
+}
+
+/**
+ * @brief Stop a measure. Call it when the echo of a sequence number is received.
+ *
+ * @param sequence Sequence number (1-99)
+ */
+void LatencyMeter::stopMeasure(uint8_t sequence){
+    if(sequence == 0 || sequence >= LATENCY_SEQUENCES || _sentTime[sequence] == 0)  return;
+    uint32_t rtt = micros() - _sentTime[sequence];
+    _sentTime[sequence] = 0;
+    if(rtt > LATENCY_TIMEOUT){
+        _lost++;
+        return;
+    }
+    _samples[_nextSample] = rtt;
+    _nextSample = (_nextSample + 1) % LATENCY_WINDOW;
+    if(_nSamples < LATENCY_WINDOW)  _nSamples++;
+    _changed = true;
+}
+
+/**
+ * @brief Return true if samples changed since the last call
+ *
+ * @return bool
+ */
+bool LatencyMeter::hasChanged(){
+    bool changed = _changed;
+    _changed = false;
+    return changed;
+}
+
+uint8_t LatencyMeter::getCount(){
+    return _nSamples;
+}
+
+/**
+ * @brief Percentile of the last LATENCY_WINDOW round trips
+ *
+ * @param p Percentile (1-100)
+ * @return uint32_t microseconds, 0 if no sample
+ */
+uint32_t LatencyMeter::percentile(uint8_t p){
+    if(_nSamples == 0)  return 0;
+    uint32_t sorted[LATENCY_WINDOW];
+    for(uint8_t i=0; i<_nSamples; i++){                                 // Insertion sort: few samples, called a few times per second
+        uint32_t v = _samples[i];
+        uint8_t j = i;
+        while(j > 0 && sorted[j-1] > v){
+            sorted[j] = sorted[j-1];
+            j--;
+        }
+        sorted[j] = v;
+    }
+    uint8_t rank = ((uint16_t)_nSamples * p + 99) / 100;
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+/**
+ * @brief Serial debug. Print round trip percentiles (us) and lost echoes
+ *
+ */
+void LatencyMeter::serialDebug(){
+    Serial.print("LATENCY "); Serial.print(_enabled ? "on" : "off");
+    Serial.print(" samples: "); Serial.print(_nSamples);
+    Serial.print(" p50: "); Serial.print(percentile(50));
+    Serial.print(" p95: "); Serial.print(percentile(95));
+    Serial.print(" p99: "); Serial.print(percentile(99));
+    Serial.print(" lost: "); Serial.print(_lost);
+    Serial.println("");
+}
@@ -0,0 +1,38 @@
+#ifndef _LATENCY_METER_H_
+#define _LATENCY_METER_H_
+
+#include <Arduino.h>
+
+#define LATENCY_SEQUENCES   100         // Sequence numbers 1-99 (two digits in the echo message). 0: no measure
+#define LATENCY_WINDOW      64          // Rolling window of the percentiles
+#define LATENCY_TIMEOUT     1000000     // us. Older pending measures are considered lost
+
+/**
+ * @brief This class measure the round trip time of drum pad hits: from the BTN_PRESSED message sent to the
+ *        Raspberry to the echo sent back by Pd once the sound has been triggered.
+ *        The sequence number of a measure travels in the value byte of BTN_PRESSED, and comes back
+ *        in a LATENCY message.
+ */
+class LatencyMeter{
+    private:
+        bool _enabled, _changed;
+        uint8_t _sequence;
+        uint32_t _sentTime[LATENCY_SEQUENCES];
+        uint32_t _samples[LATENCY_WINDOW];
+        uint8_t _nSamples, _nextSample;
+        uint16_t _lost;
+
+    public:
+        LatencyMeter();
+        void setEnabled(bool enabled);
+        bool isEnabled();
+        void reset();
+        uint8_t startMeasure();
+        void stopMeasure(uint8_t sequence);
+        bool hasChanged();
+        uint8_t getCount();
+        uint32_t percentile(uint8_t p);
+        void serialDebug();
+};
+
+#endif
@@ -0,0 +1,107 @@
+#include "LoopStats.h"
+
+/**
+ * @brief Construct a new LoopStats
+ *
+ * @param drumpad Keypad whose scan gap is reported
+ * @param trackpad Keypad whose scan gap is reported
+ */
+LoopStats::LoopStats(KeypadBase* drumpad, KeypadBase* trackpad){
+    _drumpad = drumpad;
+    _trackpad = trackpad;
+    _lastLoop = 0;
+    reset();
+}
+
+/**
+ * @brief Record the time since the previous call. Must be called once per main loop iteration.
+ *
+ */
+void LoopStats::recordLoop(){
+    uint32_t now = micros();
+    if(_lastLoop != 0){
+        uint32_t period = now - _lastLoop;
+        uint8_t b = (period == 0) ? 0 : 32 - __builtin_clz(period);
+        if(b >= LOOP_STATS_BUCKETS)  b = LOOP_STATS_BUCKETS - 1;
+        _buckets[b]++;
+        if(period > _maxPeriod)  _maxPeriod = period;
+        _count++;
+    }
+    _lastLoop = now;
+}
+
+/**
+ * @brief Clear histogram, max period and keypads scan gap
+ *
+ */
+void LoopStats::reset(){
+    memset(_buckets, 0, sizeof(_buckets));
+    _maxPeriod = 0;
+    _count = 0;
+    _drumpad->resetScanGap();
+    _trackpad->resetScanGap();
+}
+
+uint32_t LoopStats::getCount(){
+    return _count;
+}
+
+/**
+ * @brief Return the longest loop period
+ *
+ * @return uint32_t microseconds
+ */
+uint32_t LoopStats::getMaxPeriod(){
+    return _maxPeriod;
+}
+
+/**
+ * @brief Loop period percentile, rounded up to the histogram bucket limit
+ *
+ * @param p Percentile (1-100)
+ * @return uint32_t microseconds
+ */
+uint32_t LoopStats::percentile(uint8_t p){
+    if(_count == 0)  return 0;
+    uint32_t target = ((uint64_t)_count * p + 99) / 100;
+    uint32_t acc = 0;
+    for(uint8_t b=0; b<LOOP_STATS_BUCKETS; b++){
+        acc += _buckets[b];
+        if(acc >= target){
+            uint32_t bound = (1UL << b) - 1;
+            return bound < _maxPeriod ? bound : _maxPeriod;
+        }
+    }
+    return _maxPeriod;
+}
+
+/**
+ * @brief Return the worst time between two scans of the same keypad
+ *
+ * @return uint32_t microseconds
+ */
+uint32_t LoopStats::getMaxScanGap(){
+    uint32_t d = _drumpad->getMaxScanGap();
+    uint32_t t = _trackpad->getMaxScanGap();
+    return d > t ? d : t;
+}
+
+/**
+ * @brief Serial debug. Print loop period histogram (us), max period and max keypad scan gap
+ *
+ */
+void LoopStats::serialDebug(){
+    Serial.print("LOOP count: "); Serial.print(_count);
+    Serial.print(" max: "); Serial.print(_maxPeriod);
+    Serial.print(" p99: "); Serial.print(percentile(99));
+    Serial.print(" drumpad scan gap: "); Serial.print(_drumpad->getMaxScanGap());
+    Serial.print(" trackpad scan gap: "); Serial.print(_trackpad->getMaxScanGap());
+    Serial.println("");
+    for(uint8_t b=0; b<LOOP_STATS_BUCKETS; b++){
+        if(_buckets[b] == 0)  continue;
+        if(b == LOOP_STATS_BUCKETS - 1)  { Serial.print("  >= "); Serial.print(1UL << (b - 1)); }
+        else                             { Serial.print("  < ");  Serial.print(1UL << b); }
+        Serial.print(" us: "); Serial.print(_buckets[b]);
+        Serial.println("");
+    }
+}
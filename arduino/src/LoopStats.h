@@ -0,0 +1,32 @@
+#ifndef _LOOP_STATS_H_
+#define _LOOP_STATS_H_
+
+#include <Arduino.h>
+#include "Keypad.h"
+
+#define LOOP_STATS_BUCKETS 21       // Bucket i: 2^(i-1) <= period < 2^i us. Last bucket: 2^19 us (~0.5 s) or more
+
+/**
+ * @brief This class record the period of every main loop iteration in a log2 histogram,
+ *        together with the worst time between two keypad scans.
+ *        It is always enabled: recording costs one micros() call per loop.
+ */
+class LoopStats{
+    private:
+        uint32_t _buckets[LOOP_STATS_BUCKETS];
+        uint32_t _lastLoop, _maxPeriod, _count;
+        KeypadBase* _drumpad;
+        KeypadBase* _trackpad;
+
+    public:
+        LoopStats(KeypadBase* drumpad, KeypadBase* trackpad);
+        void recordLoop();
+        void reset();
+        uint32_t getCount();
+        uint32_t getMaxPeriod();
+        uint32_t percentile(uint8_t p);
+        uint32_t getMaxScanGap();
+        void serialDebug();
+};
+
+#endif
@@ -1,5 +1,11 @@
 #include "Looper.h"
 #include "Keypad.h"
+#include "Profiler.h"
+#include "InputTrace.h"
+
+static_assert(BEAT_STEPS == TFT_POSITION_STEPS, "One BeatClock step per rectangle of the position bar");
+
+static const uint16_t TRACK_COLORS[] = {ILI9341_BLUE, ILI9341_GREEN, ILI9341_YELLOW, ILI9341_RED};    // Loop track color of each column
 
 /**
  * @brief Looper constructor
@@ -10,10 +16,12 @@
  * @param tft TFT object to control tft screen and encoder 
  * @param leds CRGB object to control leds
  * @param muteKey Key object to mute loop tracks
+ * @param keyRoles Action of each key, indexed by key id (drumpad and trackpad)
+ * @param nKeyRoles Size of keyRoles
  * @param s Serial used to communicate with Raspberry
  * @param baudRate Serial baud rate
  */
-Looper:: Looper(Keypad* drumpad, Keypad* trackpad, Track* loopTracks, Track* loopMaster, TFT* tft, CRGB* leds, Key * muteKey, HardwareSerial* s, double baudRate){
+Looper:: Looper(KeypadBase* drumpad, KeypadBase* trackpad, Track* loopTracks, Track* loopMaster, TFT* tft, CRGB* leds, Key * muteKey, const KeyRole* keyRoles, uint8_t nKeyRoles, HardwareSerial* s, double baudRate){
     _drumpad = drumpad;
     _trackpad = trackpad;
     _loopTracks = loopTracks;
@@ -22,8 +30,18 @@ Looper:: Looper(Keypad* drumpad, Keypad* trackpad, Track* loopTracks, Track* loo
     _tftObj = tft;
     _leds = leds;
     _muteKey = muteKey;
+    _keyRoles = keyRoles;
+    _nKeyRoles = nKeyRoles;
+    _muteModifier = false;
     _serial = s;
     _baudRate = baudRate;
+    _ledsChanged = false;
+    _keyScanIsr = false;
+    _volumeDirty = 0;
+    _latency = NULL;
+    _beatClock = NULL;
+    _shownBars = 0;
+    _shownStep = POSITION_NONE;
 }
 
 /**
@@ -41,7 +59,6 @@ void Looper::init(){
     _tftObj->init();
 
     // Assign graphic part to each track and initialize loop tracks
-    int colors[] = {ILI9341_BLUE, ILI9341_GREEN, ILI9341_YELLOW, ILI9341_RED};
     uint16_t xStart = 40, yStart = 120;
     uint8_t spacingX = 10, spacingY = 10;
     uint16_t h = 50, w =50, radius = 3;
@@ -50,7 +67,7 @@ void Looper::init(){
         uint16_t y = yStart + r * (h+spacingY);
         for(uint8_t c=0; c<_trackpad->getNumberColumns(); c++){
             uint16_t x = xStart + c * (w+spacingX);
-            _loopTracks[id].setGraphics(x, y, h, w, radius, colors[c]);
+            _loopTracks[id].setGraphics(x, y, h, w, radius, TRACK_COLORS[c]);
             _loopTracks[id].init();
             _tftObj->drawLoopTrack( _loopTracks[id]);
             id++;
@@ -59,6 +76,26 @@ void Looper::init(){
     _loopMaster->init();
 }
 
+/**
+ * @brief Set the meter of the pad-to-sound latency. When it is enabled, drum pad BTN_PRESSED messages
+ *        carry a sequence number that Pd echoes back in a LATENCY message.
+ * 
+ * @param latency 
+ */
+void Looper::setLatencyMeter(LatencyMeter* latency){
+    _latency = latency;
+}
+
+/**
+ * @brief Set the clock animating the loop position between the bar syncs of Pd.
+ *        Without it the position is drawn at every COUNTER message.
+ * 
+ * @param beatClock 
+ */
+void Looper::setBeatClock(BeatClock* beatClock){
+    _beatClock = beatClock;
+}
+
 /**
  * @brief Send data to Raspberry though serial
  * 
@@ -70,6 +107,7 @@ void Looper::init(){
  *                   5: OVERDUB
  *                   6: AUDIO_INPUT
  *                   7: LOOP_PRESSED
+ *                   8: VOLUME
  * @param btnId Pressed button's ID / Loop track
  * @param value Used to send potentiometers values (volume) 
  */
@@ -79,6 +117,35 @@ void Looper::sendDataToPi(Channel msgChannel, uint8_t btnId, uint8_t value){
     _serial->write(value);
 }
 
+/**
+ * @brief Send a timestamped event to Raspberry though serial (7 bytes).
+ *        The channel byte has MSG_TIMESTAMP_FLAG set. The timestamp lets Pd play the event at a fixed
+ *        latency from its detection, whatever the delay of the serial link, of Python and of Pd.
+ * 
+ * @param msgChannel See sendDataToPi(Channel, uint8_t, uint8_t)
+ * @param btnId Pressed button's ID / Loop track
+ * @param value Message value
+ * @param timestamp micros() when the event has been detected
+ */
+void Looper::sendDataToPi(Channel msgChannel, uint8_t btnId, uint8_t value, uint32_t timestamp){
+    uint8_t buf[7] = {(uint8_t)(msgChannel | MSG_TIMESTAMP_FLAG), btnId, value,
+                      (uint8_t)timestamp, (uint8_t)(timestamp >> 8), (uint8_t)(timestamp >> 16), (uint8_t)(timestamp >> 24)};
+    _serial->write(buf, sizeof(buf));
+}
+
+
+
+/**
+ * @brief Send a 12 bit volume to Raspberry though serial (4 bytes).
+ *        The channel byte is VOLUME with MSG_WIDE_FLAG set, the value is 16 bit.
+ * 
+ * @param trackId Loop track (0-7) or master (9)
+ * @param volume 12 bit volume
+ */
+void Looper::sendVolumeToPi(uint8_t trackId, uint16_t volume){
+    uint8_t buf[4] = {(uint8_t)(VOLUME | MSG_WIDE_FLAG), trackId, (uint8_t)volume, (uint8_t)(volume >> 8)};
+    _serial->write(buf, sizeof(buf));
+}
 
 
 /**
@@ -89,7 +156,9 @@ void Looper::getDataFromPi(){
     uint8_t buffer[3], i=0;
     if(_serial->available() >= 3){
         while(_serial->available() > 0){
-            buffer[i] = (_serial->read() - '0');
+            uint8_t c = _serial->read();
+            TRACE_SERIAL(c);
+            buffer[i] = (c - '0');
             i++;
             if( i== 3){
                updateTrackState(buffer); 
@@ -114,116 +183,368 @@ void Looper::getDataFromPi(){
  *             If msg[0] == 1:COUNTER
  *              msg[1]: actual metronome count
  *              msg[2]: metronome max value
+ *              Pd sends only the start of a bar (count 0): the position is animated by the BeatClock
+ *
+ *             If msg[0] == 2:LATENCY
+ *              msg[1], msg[2]: tens and units of the sequence number of a BTN_PRESSED message
  */
 void Looper::updateTrackState(uint8_t *msg){
     TrackState newState = static_cast<TrackState>(msg[1]);  
     uint8_t trackNumber = msg[2] - 1;                                                                   // In puredata tracknumber goes from 1-8    
     if(msg[0] == STATUS){
-        if(_loopTracks[trackNumber].state == MUTE_REC && newState == MUTE_REC)    newState = STOP_REC;   // If already mute then unmute
-        _loopTracks[trackNumber].state = newState;                                                       
-        changeTrackLedColor(trackNumber);
-        _tftObj->drawLoopTrack(_loopTracks[trackNumber]);
+        if(_loopTracks[trackNumber].getConfirmedState() == MUTE_REC && newState == MUTE_REC)  newState = STOP_REC;   // If already mute then unmute
+        if(_loopTracks[trackNumber].confirmState(newState))     showTrackState(trackNumber);                 // Unless already predicted
     }
     else if(msg[0] == COUNTER){
         _bpmCount = msg[1];
         _bpm = msg[2];
-        _tftObj->drawBpm((String)_bpm);
-        _tftObj->drawPosition(_bpmCount);
-    }  
+        _tftObj->drawBpm(_bpm);
+        if(_beatClock == NULL)      _tftObj->drawPosition(_bpmCount);
+        else if(_bpmCount == 0)     _beatClock->sync(micros());                                         // Bar start
+    }
+    else if(msg[0] == LATENCY){
+        if(_latency != NULL)    _latency->stopMeasure(msg[1] * 10 + msg[2]);
+    }
 }
 
 
 /**
- * @brief Update drumpad buttons.
- *        Get pressed buttons and send a message to Raspberry if pressed.
- *        Change button's led color.
+ * @brief Scan drumpad buttons every KEYPAD_SCAN_INTERVAL us (polled mode).
+ *        Changed buttons are queued as KeyEvent and handled by updateKeys().
  */
 void Looper::updateDrumpad(){
-    // Update drumPad
-    Key k; CRGB ledColor;
+    PROFILE_ZONE(ZONE_UPDATE_DRUMPAD);
     if (_drumpad->getKeys()){
-        for (uint8_t i=0; i< (_drumpad->getNumberKeys()) ; i++){            // Scan the whole key list.
-            k = _drumpad->keys[i];
-            if(i>=12){                                                       //TODO: treat last four button as trackpad cancel ALL if statement
-                Channel msgCh;
-                if (k.stateChanged && k.state != RELEASED){                                     // Only find keys that have changed state.
-                msgCh = LOOP_PRESSED;                                                       // Start-stop rec
-                if (k.state == HOLD){
-                    msgCh = CLEAR_LOOP;                                                     // Clear
-                }                                 
-                else if(_loopTracks[i-12].state == STOP_REC && k.state == PRESSED){
-                    if(_muteKey->state == PRESSED )  msgCh = LOOP_PRESSED;           
-                    else                             msgCh = OVERDUB;                       // Overdub 
-                }              
-                sendDataToPi(msgCh, i-12, 0);                                                // Send data to Pi. Channel, id(0-7), value (not used)
-           }
-            } 
-            else{                                                              
-            if ( k.stateChanged){                                           // Only find keys that have changed state.
-                if(k.state != RELEASED){
-                    sendDataToPi(BTN_PRESSED, k.id, 0);                     // Send data to Pi. 
-                    ledColor = CRGB::Cyan;
-                }
-                else{
-                    ledColor = CRGB::Black;
-                }
-                changeLedColor(k.idLed, ledColor);
-            }
-            }
-        }
+        _drumpad->pushEvents(&_keyEvents, DRUMPAD);
     }
 }
 
 
 /**
- * @brief Update trackpad buttons.
- *        Get pressed buttons and send a message to Raspberry if pressed.
- *        Update loop tracks status.
- *        Update loop tracks volume.
+ * @brief Scan trackpad buttons every KEYPAD_SCAN_INTERVAL us (polled mode).
+ *        Changed buttons are queued as KeyEvent and handled by updateKeys().
  */
 void Looper::updateTrackpad(){
-    Key k; Channel msgCh;
+    PROFILE_ZONE(ZONE_UPDATE_TRACKPAD);
     if (_trackpad->getKeys()){
-        for (uint8_t i=0; i< (_trackpad->getNumberKeys()) ; i++){                           // Scan the whole key list.
-            k = _trackpad->keys[i];           
-            if (k.stateChanged && k.state != RELEASED){                                     // Only find keys that have changed state.
-                msgCh = LOOP_PRESSED;                                                       // Start-stop rec
-                if (k.state == HOLD){
-                    msgCh = CLEAR_LOOP;                                                     // Clear
-                }                                 
-                else if(_loopTracks[i].state == STOP_REC && k.state == PRESSED){
-                    if(_muteKey->state == PRESSED )  msgCh = LOOP_PRESSED;           
-                    else                             msgCh = OVERDUB;                       // Overdub 
-                }              
-                sendDataToPi(msgCh, i, 0);                                                   // Send data to Pi. Channel, id(0-7), value (not used)
-           }
+        _trackpad->pushEvents(&_keyEvents, TRACKPAD);
+    }
+}
+
+
+/**
+ * @brief Scan drumpad and trackpad matrix and queue changed buttons.
+ *        Called by a timer interrupt when enableKeyScanIsr() has been called.
+ */
+void Looper::scanKeys(){
+    PROFILE_ISR_ZONE(ZONE_SCAN_KEYS_ISR);
+    if (_drumpad->scanKeys())   _drumpad->pushEvents(&_keyEvents, DRUMPAD);
+    if (_trackpad->scanKeys())  _trackpad->pushEvents(&_keyEvents, TRACKPAD);
+}
+
+
+/**
+ * @brief From now on keypads are scanned by scanKeys() from a timer interrupt.
+ *        updateKeys() only handles queued events.
+ */
+void Looper::enableKeyScanIsr(){
+    _keyScanIsr = true;
+}
+
+
+/**
+ * @brief Number of key events lost because the queue was full
+ * 
+ * @return uint16_t
+ */
+uint16_t Looper::getDroppedKeyEvents(){
+    return _keyEvents.getDropped();
+}
+
+
+/**
+ * @brief Update drumpad and trackpad buttons.
+ *        Scan keypads (if not scanned by interrupt) and handle all queued key events.
+ */
+void Looper::updateKeys(){
+    if(!_keyScanIsr){
+        updateDrumpad();
+        updateTrackpad();
+    }
+    KeyEvent e;
+    while(_keyEvents.pop(e)){
+        handleKey(e);
+    }
+}
+
+
+/**
+ * @brief Handle a button change of any keypad: the action is looked up in the key role table by key id.
+ * 
+ * @param e Key event
+ */
+void Looper::handleKey(const KeyEvent& e){
+    if(e.id >= _nKeyRoles)  return;
+    const KeyRole& role = _keyRoles[e.id];
+    KeyState state = (KeyState)e.edge;
+    switch(role.action){
+        case KEY_DRUM_HIT:
+            handleDrumKey(e, role.arg);
+            break;
+        case KEY_LOOP:
+            handleLoopKey(role.arg, state, e.timestamp);
+            break;
+        case KEY_CLEAR:
+            if(state == PRESSED)    sendDataToPi(CLEAR_LOOP, role.arg, 0, e.timestamp);
+            break;
+        case KEY_OVERDUB:
+            if(state == PRESSED)    sendDataToPi(OVERDUB, role.arg, 0, e.timestamp);
+            break;
+        case KEY_MUTE:
+            _muteModifier = (state != RELEASED);
+            break;
+    }
+}
+
+
+/**
+ * @brief Handle a drum button change.
+ *        Send a message to Raspberry if pressed. Change button's led color.
+ * 
+ * @param e Key event
+ * @param soundId Sound to play
+ */
+void Looper::handleDrumKey(const KeyEvent& e, uint8_t soundId){
+    CRGB ledColor;
+    if(e.edge == LONG_HOLD)     return;                                 // Second hold stage is only used by loop keys
+    if(e.edge != RELEASED){
+        uint8_t sequence = (_latency != NULL) ? _latency->startMeasure() : 0;
+        sendDataToPi(BTN_PRESSED, soundId, sequence, e.timestamp);      // Send data to Pi. Value: latency sequence number or 0
+        ledColor = CRGB::Cyan;
+    }
+    else{
+        ledColor = CRGB::Black;
+    }
+    KeypadBase* keypad = (e.source == DRUMPAD) ? _drumpad : _trackpad;
+    changeLedColor(keypad->keys[e.index].idLed, ledColor);
+}
+
+
+/**
+ * @brief Send a message to Raspberry to control a loop track.
+ *        Press: start-stop rec (or overdub if the track is playing and mute key/modifier is not pressed).
+ *        Hold: clear loop track. Long hold: clear all loop tracks.
+ * 
+ * @param trackNumber Loop track (0-7)
+ * @param state New state of the button
+ * @param timestamp micros() when the change has been detected
+ */
+void Looper::handleLoopKey(uint8_t trackNumber, KeyState state, uint32_t timestamp){
+    Channel msgCh;
+    if (state != RELEASED){
+        msgCh = LOOP_PRESSED;                                                       // Start-stop rec
+        if (state == HOLD){
+            msgCh = CLEAR_LOOP;                                                     // Clear
+        }
+        else if (state == LONG_HOLD){
+            msgCh = CLEAR_ALL;                                                      // Clear all
+        }                                 
+        else if(_loopTracks[trackNumber].state == STOP_REC && state == PRESSED){
+            if(_muteKey->state != RELEASED || _muteModifier)  msgCh = LOOP_PRESSED;
+            else                             msgCh = OVERDUB;                       // Overdub 
+        }              
+        sendDataToPi(msgCh, trackNumber, 0, timestamp);                             // Send data to Pi. Channel, id(0-7), value (not used)
+        uint8_t first = (msgCh == CLEAR_ALL) ? 0 : trackNumber;
+        uint8_t last = (msgCh == CLEAR_ALL) ? _loopTracksNumber - 1 : trackNumber;
+        for(uint8_t i=first; i<=last; i++){
+            TrackState predicted;
+            if(!predictTrackState(i, msgCh, &predicted))   continue;
+            _loopTracks[i].predictState(predicted, timestamp);
+            showTrackState(i);
         }
     }
-    // Update track volume
-    bool volumeChanged = false;
+}
+
+
+/**
+ * @brief Local mirror of the loop state machine in Pd (loop.pd): the state Pd will report first
+ *        after a message. Only the certain transitions are predicted, the others wait for Pd.
+ *          CLEAR_REC       LOOP_PRESSED    START_REC if no other loop exists, WAIT_REC (next bar) otherwise
+ *          START_REC       LOOP_PRESSED    STOP_REC
+ *          STOP_REC        LOOP_PRESSED    MUTE_REC
+ *          STOP_REC        OVERDUB         WAIT_REC (next bar)
+ *          MUTE_REC        LOOP_PRESSED    STOP_REC
+ *          any but clear   CLEAR_LOOP, CLEAR_ALL   CLEAR_REC
+ *
+ * @param trackNumber Loop track (0-7)
+ * @param msgCh Message just sent to Pd
+ * @param predicted Predicted state
+ * @return bool False if the state is not predicted
+ */
+bool Looper::predictTrackState(uint8_t trackNumber, Channel msgCh, TrackState* predicted){
+    TrackState current = _loopTracks[trackNumber].state;
+    if(msgCh == CLEAR_LOOP || msgCh == CLEAR_ALL){
+        *predicted = CLEAR_REC;
+        return current != CLEAR_REC;
+    }
+    if(msgCh == OVERDUB){
+        *predicted = WAIT_REC;
+        return current == STOP_REC;
+    }
+    if(msgCh != LOOP_PRESSED)   return false;
+    switch(current){
+        case CLEAR_REC:
+            *predicted = START_REC;
+            for(uint8_t i=0; i<_loopTracksNumber; i++){
+                if(i != trackNumber && _loopTracks[i].state != CLEAR_REC)   *predicted = WAIT_REC;
+            }
+            return true;
+        case START_REC:     *predicted = STOP_REC;  return true;
+        case STOP_REC:      *predicted = MUTE_REC;  return true;
+        case MUTE_REC:      *predicted = STOP_REC;  return true;
+        default:            return false;
+    }
+}
+
+
+/**
+ * @brief Show the state of a loop track: led color and TFT tile
+ *
+ * @param trackNumber Loop track (0-7)
+ */
+void Looper::showTrackState(uint8_t trackNumber){
+    changeTrackLedColor(trackNumber);
+    _tftObj->drawLoopTrack(_loopTracks[trackNumber]);
+}
+
+
+/**
+ * @brief Roll back the predicted track states not confirmed by Pd in time
+ *
+ */
+void Looper::expirePredictions(){
+    uint32_t now = micros();
     for(uint8_t i=0; i<_loopTracksNumber; i++){
-       volumeChanged = _loopTracks[i].update();
-       if(volumeChanged){
-           sendDataToPi(VOLUME, _loopTracks[i].getId(),  _loopTracks[i].getVolume());
-       }
+        if(_loopTracks[i].expirePrediction(now))    showTrackState(i);
     }
-    // Update master volume
-    if(_loopMaster->update()){
-         sendDataToPi(VOLUME, _loopMaster->getId(),   _loopMaster->getVolume());
+}
+
+
+/**
+ * @brief Update loop tracks and master volume.
+ *        A changed volume is marked dirty, flushVolumes() sends it.
+ */
+void Looper::updateVolumes(){
+    for(uint8_t i=0; i<_loopTracksNumber; i++){
+       if(_loopTracks[i].update())  _volumeDirty |= (1 << i);
     }
+    if(_loopMaster->update())       _volumeDirty |= VOLUME_MASTER_DIRTY;
 }
 
 
-void Looper::update(){
-  updateDrumpad();
+/**
+ * @brief Send the dirty volumes to Raspberry, one message per track with its latest value.
+ *        Called at a fixed rate, so a fader move costs at most one message per track and frame.
+ */
+void Looper::flushVolumes(){
+    if(_volumeDirty == 0)   return;
+    for(uint8_t i=0; i<_loopTracksNumber; i++){
+       if(_volumeDirty & (1 << i))  sendVolumeToPi(_loopTracks[i].getId(), _loopTracks[i].getVolume());
+    }
+    if(_volumeDirty & VOLUME_MASTER_DIRTY)  sendVolumeToPi(_loopMaster->getId(), _loopMaster->getVolume());
+    _volumeDirty = 0;
+}
+
+
+/**
+ * @brief Update mute key state.
+ * 
+ */
+void Looper::updateMuteKey(){
   _muteKey->update(_muteKey->pin);
-  updateTrackpad();
-  _tftObj->update();
+  TRACE_DIGITAL(_muteKey->pin, !_muteKey->actualValue);
+}
+
+/**
+ * @brief Read menu encoder switch. Must be called more often than updateMenu() to not miss presses
+ *        (steps are decoded in the encoder interrupt).
+ * 
+ */
+void Looper::updateEncoder(){
+  _tftObj->pollEncoder();
+}
+
+/**
+ * @brief Draw pad-to-sound latency percentiles on TFT when they change.
+ * 
+ */
+void Looper::updateLatency(){
+  if(_latency == NULL || !_latency->hasChanged())  return;
+  if(_latency->isEnabled())   _tftObj->drawLatency(_latency->percentile(50), _latency->percentile(95), _latency->percentile(99));
+  else                        _tftObj->clearLatency();
+}
+
+/**
+ * @brief Draw the loop position animated by the BeatClock: clear the bar and draw step 0 at every sync,
+ *        then fill only the steps reached since the last call.
+ * 
+ */
+void Looper::updatePosition(){
+  if(_beatClock == NULL)  return;
+  uint32_t bars = _beatClock->getBars();
+  uint8_t step = _beatClock->getStep();
+  if(bars == 0)  return;                                                      // No sync yet
+  if(bars != _shownBars){
+    _tftObj->fillPosition(0, TFT_POSITION_STEPS - 1, ILI9341_BLACK);
+    _shownBars = bars;
+    _shownStep = POSITION_NONE;
+  }
+  if(_shownStep != POSITION_NONE && step <= _shownStep)  return;
+  _tftObj->fillPosition(_shownStep == POSITION_NONE ? 0 : _shownStep + 1, step, ILI9341_WHITE);
+  _shownStep = step;
+}
+
+/**
+ * @brief Update TFT menu and send selected sound to Raspberry.
+ * 
+ */
+void Looper::updateMenu(){
+  _tftObj->updateMenu();
   if(_tftObj->loadSound()){
     sendDataToPi(DRUMPAD_SOUND,_tftObj->getSelectedItem(), 0);
   }
 }
 
+/**
+ * @brief Push led colors to the strip, only if any of them changed.
+ * 
+ */
+void Looper::showLeds(){
+  if(_ledsChanged){
+    PROFILE_ZONE(ZONE_SHOW_LEDS);
+    FastLED.show();
+    _ledsChanged = false;
+  }
+}
+
+/**
+ * @brief Update the whole looper in one pass.
+ *        Use it when the single parts are not called by a Scheduler.
+ * 
+ */
+void Looper::update(){
+  updateMuteKey();
+  updateKeys();
+  updateVolumes();
+  flushVolumes();
+  updateEncoder();
+  updateMenu();
+  updateLatency();
+  updatePosition();
+  expirePredictions();
+  showLeds();
+}
+
 /**
  * @brief Update loop track's led color depending on its state.
  * 
@@ -258,14 +579,16 @@ void Looper::changeTrackLedColor(uint8_t trackNumber){
 }
 
 /**
- * @brief Change neopixel led color
+ * @brief Change neopixel led color.
+ *        The strip is refreshed by showLeds().
  * 
  * @param ledId led ID (position in the strip)
  * @param color CRGB color
  */
 void Looper::changeLedColor(uint8_t ledId, CRGB color){
+    PROFILE_ZONE(ZONE_CHANGE_LED_COLOR);
     _leds[ledId] = color;
-    FastLED.show();
+    _ledsChanged = true;
 }
 
 
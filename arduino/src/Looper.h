@@ -4,11 +4,34 @@
 #include "Keypad.h"
 #include "TFT.h"
 #include "Track.h"
+#include "LatencyMeter.h"
+#include "BeatClock.h"
 #include <FastLED.h>
 
-typedef enum {STATUS, COUNTER } MsgId;
+typedef enum {STATUS, COUNTER, LATENCY} MsgId;
+typedef enum {DRUMPAD, TRACKPAD} KeypadSource;
 typedef enum {AUDIO_MASTER, DRUMPAD_SOUND, BTN_PRESSED, CLEAR_LOOP, CLEAR_ALL, OVERDUB, AUDIO_INPUT, LOOP_PRESSED, VOLUME}Channel;
 
+typedef enum {KEY_NONE, KEY_DRUM_HIT, KEY_LOOP, KEY_CLEAR, KEY_OVERDUB, KEY_MUTE} KeyAction;
+
+/**
+ * @brief Action of a key, in a table indexed by key id (see main.cpp)
+ *          KEY_DRUM_HIT    play sound arg (BTN_PRESSED)
+ *          KEY_LOOP        control loop track arg: rec/overdub, clear on hold, clear all on long hold
+ *          KEY_CLEAR       clear loop track arg
+ *          KEY_OVERDUB     overdub loop track arg
+ *          KEY_MUTE        mute modifier, same as the mute key (arg not used)
+ */
+typedef struct {
+    uint8_t action;                     // KeyAction
+    uint8_t arg;                        // Sound id or loop track (0-7)
+} KeyRole;
+
+#define MSG_TIMESTAMP_FLAG  0x80        // Set in the channel byte of a message followed by its timestamp (uint32 us, little endian)
+#define MSG_WIDE_FLAG       0x40        // Set in the channel byte of a message with a 16 bit value (little endian)
+#define VOLUME_MASTER_DIRTY 0x8000      // Bit of the master in the dirty volumes mask (bit i: loop track i)
+#define POSITION_NONE       0xFF        // No step of the current bar drawn yet
+
 /**
  * @brief This class control a looper station.
  *        It is composed by:
@@ -20,27 +43,60 @@ typedef enum {AUDIO_MASTER, DRUMPAD_SOUND, BTN_PRESSED, CLEAR_LOOP, CLEAR_ALL, O
  */
 class Looper{
     private:
-        Keypad* _drumpad;
-        Keypad* _trackpad;
+        KeypadBase* _drumpad;
+        KeypadBase* _trackpad;
         HardwareSerial* _serial;
         double _baudRate;
         Track* _loopTracks;
         Track* _loopMaster;
         Key* _muteKey;                
+        const KeyRole* _keyRoles;
+        uint8_t _nKeyRoles;
+        bool _muteModifier;
         uint8_t _bpmCount;
         uint8_t _bpm;
         CRGB* _leds;
         TFT* _tftObj;
+        LatencyMeter* _latency;
+        BeatClock* _beatClock;
+        uint32_t _shownBars;
+        uint8_t _shownStep;
         uint8_t _loopTracksNumber;
+        bool _ledsChanged;
+        KeyEventQueue _keyEvents;
+        volatile bool _keyScanIsr;
+        uint16_t _volumeDirty;                  // Volumes changed since the last flush
+        void handleKey(const KeyEvent& e);
+        void handleDrumKey(const KeyEvent& e, uint8_t soundId);
+        void handleLoopKey(uint8_t trackNumber, KeyState state, uint32_t timestamp);
+        bool predictTrackState(uint8_t trackNumber, Channel msgCh, TrackState* predicted);
+        void showTrackState(uint8_t trackNumber);
         
     public:
-        Looper(Keypad* drumpad, Keypad* trackpad, Track* loopTracks, Track* loopMaster, TFT* tft, CRGB* leds, Key * muteKey, HardwareSerial* s, double baudRate);
+        Looper(KeypadBase* drumpad, KeypadBase* trackpad, Track* loopTracks, Track* loopMaster, TFT* tft, CRGB* leds, Key * muteKey, const KeyRole* keyRoles, uint8_t nKeyRoles, HardwareSerial* s, double baudRate);
         void init();
+        void setLatencyMeter(LatencyMeter* latency);
+        void setBeatClock(BeatClock* beatClock);
         void sendDataToPi(Channel msgChannel, uint8_t btnId, uint8_t value);
+        void sendDataToPi(Channel msgChannel, uint8_t btnId, uint8_t value, uint32_t timestamp);
+        void sendVolumeToPi(uint8_t trackId, uint16_t volume);
         void updateTrackState( uint8_t *msg);
+        void expirePredictions();
         void update();
+        void updateKeys();
         void updateDrumpad();
         void updateTrackpad();
+        void scanKeys();
+        void enableKeyScanIsr();
+        uint16_t getDroppedKeyEvents();
+        void updateVolumes();
+        void flushVolumes();
+        void updateMuteKey();
+        void updateMenu();
+        void updateEncoder();
+        void updateLatency();
+        void updatePosition();
+        void showLeds();
         void changeLedColor(uint8_t ledId, CRGB color);
         void changeTrackLedColor(uint8_t trackNumber);
         void getDataFromPi();
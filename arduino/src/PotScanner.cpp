@@ -0,0 +1,301 @@
+#include "PotScanner.h"
+#include "InputTrace.h"
+
+/**
+ * @brief Construct a new PotScanner
+ *
+ * @param muxAnalogIn Analog pin connected to the CD4051 output
+ * @param muxS0 Mux select pins
+ * @param muxS1
+ * @param muxS2
+ * @param directAnalogIn Analog pin of a pot without mux
+ */
+PotScanner::PotScanner(uint8_t muxAnalogIn, uint8_t muxS0, uint8_t muxS1, uint8_t muxS2, uint8_t directAnalogIn){
+    _muxAnalogIn = muxAnalogIn;
+    _muxS0 = muxS0;
+    _muxS1 = muxS1;
+    _muxS2 = muxS2;
+    _directAnalogIn = directAnalogIn;
+    _muxChannel = 0;
+    _sequence = POT_SEQ_MUX | POT_SEQ_DIRECT;
+    _conversions = 0;
+    _settleUs = 0;
+    _sampled = 0;
+    memset((void*)_pots, 0, sizeof(_pots));
+}
+
+/**
+ * @brief Drive the mux select lines through the PIO registers (callable from the interrupt)
+ *
+ * @param channel Mux input (0-7)
+ */
+void PotScanner::selectMux(uint8_t channel){
+    for(uint8_t b=0; b<3; b++){
+        if(channel & (1 << b))  _selPorts[b]->PIO_SODR = _selMasks[b];
+        else                    _selPorts[b]->PIO_CODR = _selMasks[b];
+    }
+}
+
+/**
+ * @brief Filter a sample: oversampling, IIR, hysteresis. Then set when the pot is sampled again.
+ *        The first filter input sets the IIR and the level, so a pot does not ramp from 0 at startup;
+ *        until then the pot is sampled at the active rate.
+ *
+ * @param index Pot (0-7: mux inputs, POT_DIRECT: direct pin)
+ * @param sample 12 bit sample
+ * @param now micros()
+ */
+void PotScanner::filter(uint8_t index, uint16_t sample, uint32_t now){
+    volatile PotChannel& p = _pots[index];
+    p.raw = sample;
+    p.time = now;
+    if(!(_sampled & (1 << index)))  p.moved = now;
+    else{
+        int32_t distance = (int32_t)sample - (p.iir >> (POT_IIR_FRAC + 16 - 12));
+        if(distance > POT_MOVE_THR || distance < -POT_MOVE_THR)     p.moved = now;
+    }
+    p.due = now + ((now - p.moved < POT_ACTIVE_TIME) ? POT_ACTIVE_PERIOD : POT_IDLE_PERIOD);
+    p.acc += sample;
+    if(++p.count < POT_OVERSAMPLING)    return;
+    int32_t x = (int32_t)p.acc << (POT_IIR_FRAC + 16 - 12 - POT_OVERSAMPLING_BITS);       // 16 bit, fixed point
+    p.acc = 0;
+    p.count = 0;
+    if(!(_sampled & (1 << index))){
+        p.iir = x;
+        p.level = x >> (POT_IIR_FRAC + 16 - POT_LEVEL_BITS);
+        _sampled |= (1 << index);
+        return;
+    }
+    p.iir += (x - p.iir) >> POT_IIR_SHIFT;
+    int32_t value = p.iir >> POT_IIR_FRAC;
+    int32_t step = 1L << (16 - POT_LEVEL_BITS);
+    if(value >= ((int32_t)p.level + 1) * step + POT_HYSTERESIS){                    // Level follows POT_HYSTERESIS behind
+        p.level = (value - POT_HYSTERESIS) >> (16 - POT_LEVEL_BITS);                // the value: one step at a time
+        p.moved = now;
+    }
+    else if(value < (int32_t)p.level * step - POT_HYSTERESIS){
+        p.level = (value + POT_HYSTERESIS) >> (16 - POT_LEVEL_BITS);
+        p.moved = now;
+    }
+}
+
+/**
+ * @brief Plan the next conversion sequence. The mux input due first is selected now, ties go round robin
+ *        from the input after the current one. A pin due within a settle time after the sequence is
+ *        converted with it, to share the trigger.
+ *
+ * @param now micros()
+ * @return uint32_t us until the next sequence, at least the settle time
+ */
+uint32_t PotScanner::schedule(uint32_t now){
+    uint8_t next = _muxChannel;
+    int32_t muxWait = INT32_MAX;
+    for(uint8_t i=1; i<=POT_MUX_CHANNELS; i++){
+        uint8_t channel = (_muxChannel + i) & (POT_MUX_CHANNELS - 1);
+        int32_t wait = (int32_t)(_pots[channel].due - now);
+        if(wait < muxWait){
+            muxWait = wait;
+            next = channel;
+        }
+    }
+    if(next != _muxChannel){
+        selectMux(next);
+        _muxChannel = next;
+    }
+    int32_t directWait = (int32_t)(_pots[POT_DIRECT].due - now);
+    int32_t wait = max(min(muxWait, directWait), (int32_t)_settleUs);
+    _sequence = 0;
+    if(muxWait <= wait + (int32_t)_settleUs)       _sequence |= POT_SEQ_MUX;
+    if(directWait <= wait + (int32_t)_settleUs)    _sequence |= POT_SEQ_DIRECT;
+    return wait;
+}
+
+/**
+ * @brief Store the results of a conversion sequence and plan the next one.
+ *        Called from the end of conversion interrupt.
+ *
+ * @param muxValue Mux output (12 bit), input _muxChannel, if the sequence had POT_SEQ_MUX
+ * @param directValue Direct pin (12 bit), if the sequence had POT_SEQ_DIRECT
+ * @return uint32_t us until the next sequence: the pins to convert are given by getSequence()
+ */
+uint32_t PotScanner::storeSample(uint16_t muxValue, uint16_t directValue){
+    uint32_t now = micros();
+    if(_sequence & POT_SEQ_MUX){
+        filter(_muxChannel, muxValue, now);
+        TRACE_ANALOG(_muxAnalogIn, _muxChannel, muxValue >> (12 - TRACE_ANALOG_BITS));
+        _conversions++;
+    }
+    if(_sequence & POT_SEQ_DIRECT){
+        filter(POT_DIRECT, directValue, now);
+        TRACE_ANALOG(_directAnalogIn, TRACE_NO_CHANNEL, directValue >> (12 - TRACE_ANALOG_BITS));
+        _conversions++;
+    }
+    return schedule(now);
+}
+
+/**
+ * @brief Index of a pot in the table
+ *
+ * @return uint8_t 0-7: mux inputs, POT_DIRECT: direct pin, POT_NO_INDEX: unknown pot
+ */
+uint8_t PotScanner::getIndex(uint8_t analogIn, uint8_t channel){
+    if(analogIn == _muxAnalogIn && channel < POT_MUX_CHANNELS)   return channel;
+    if(analogIn == _directAnalogIn)                             return POT_DIRECT;
+    return POT_NO_INDEX;
+}
+
+/**
+ * @brief Last sample of a pot
+ *
+ * @param analogIn Analog pin
+ * @param channel Mux input, or POT_NO_CHANNEL for the direct pin
+ * @return uint16_t 12 bit value, 0 for an unknown pot
+ */
+uint16_t PotScanner::read(uint8_t analogIn, uint8_t channel){
+    uint8_t index = getIndex(analogIn, channel);
+    return index != POT_NO_INDEX ? _pots[index].raw : 0;
+}
+
+/**
+ * @brief Filtered level of a pot
+ *
+ * @param analogIn Analog pin
+ * @param channel Mux input, or POT_NO_CHANNEL for the direct pin
+ * @return uint16_t POT_LEVEL_BITS value, 0 for an unknown pot
+ */
+uint16_t PotScanner::readLevel(uint8_t analogIn, uint8_t channel){
+    uint8_t index = getIndex(analogIn, channel);
+    return index != POT_NO_INDEX ? _pots[index].level : 0;
+}
+
+/**
+ * @brief Time since the last sample of a pot
+ *
+ * @param analogIn Analog pin
+ * @param channel Mux input, or POT_NO_CHANNEL for the direct pin
+ * @return uint32_t us, POT_NO_SAMPLE if the pot has no filtered level yet
+ */
+uint32_t PotScanner::getSampleAge(uint8_t analogIn, uint8_t channel){
+    uint8_t index = getIndex(analogIn, channel);
+    if(index == POT_NO_INDEX || !(_sampled & (1 << index)))    return POT_NO_SAMPLE;
+    return micros() - _pots[index].time;
+}
+
+/**
+ * @brief Serial debug. Print sample, filtered level, sample age (us) and rate of every pot
+ *
+ */
+void PotScanner::serialDebug(){
+    Serial.print("POTS conversions: "); Serial.println(_conversions);
+    for(uint8_t i=0; i<=POT_DIRECT; i++){
+        uint8_t channel = (i < POT_DIRECT) ? i : POT_NO_CHANNEL;
+        uint8_t pin = (i < POT_DIRECT) ? _muxAnalogIn : _directAnalogIn;
+        Serial.print(i < POT_DIRECT ? "  mux " : "  direct ");
+        if(i < POT_DIRECT)    Serial.print(i);
+        Serial.print(" raw: "); Serial.print(read(pin, channel));
+        Serial.print(" level: "); Serial.print(readLevel(pin, channel));
+        Serial.print(" age: "); Serial.print(getSampleAge(pin, channel));
+        Serial.println(micros() - _pots[i].moved < POT_ACTIVE_TIME ? " active" : " idle");
+    }
+}
+
+/**
+ * @brief Number of pot samples converted since the start
+ *
+ * @return uint32_t
+ */
+uint32_t PotScanner::getConversions(){
+    return _conversions;
+}
+
+
+#ifdef ARDUINO_ARCH_SAM
+
+static PotScanner* _scanner = NULL;
+static uint16_t _dma[2];                               // PDC buffer: one conversion sequence
+static uint8_t _muxAdcChannel, _directAdcChannel;
+static uint32_t _ticksPerUs;
+
+/**
+ * @brief Enable the ADC channels of a conversion sequence and arm the PDC for their results
+ *
+ * @param sequence POT_SEQ_* pins
+ */
+static void armSequence(uint8_t sequence){
+    uint32_t channels = 0;
+    if(sequence & POT_SEQ_MUX)       channels |= (1 << _muxAdcChannel);
+    if(sequence & POT_SEQ_DIRECT)    channels |= (1 << _directAdcChannel);
+    ADC->ADC_CHDR = ~channels & 0xFFFF;
+    ADC->ADC_CHER = channels;
+    ADC->ADC_RPR = (uint32_t)_dma;
+    ADC->ADC_RCR = __builtin_popcount(channels);
+}
+
+/**
+ * @brief Start the acquisition.
+ *        TC0 channel 0 in waveform mode raises TIOA0 at the end of every period, TIOA0 triggers a conversion
+ *        of the enabled pins, the PDC moves the results (tagged with their ADC channel) to RAM and raises ENDRX.
+ *        The interrupt sets the period (RC) to the time until the next sequence.
+ *
+ * @param settleUs Minimum time between the mux switch and the next conversion sequence
+ */
+void PotScanner::start(uint32_t settleUs){
+    _scanner = this;
+    _settleUs = settleUs;
+    const uint8_t sel[3] = {_muxS0, _muxS1, _muxS2};
+    for(uint8_t b=0; b<3; b++){
+        pinMode(sel[b], OUTPUT);
+        _selPorts[b] = digitalPinToPort(sel[b]);
+        _selMasks[b] = digitalPinToBitMask(sel[b]);
+    }
+    _muxChannel = 0;
+    _sequence = POT_SEQ_MUX | POT_SEQ_DIRECT;
+    selectMux(0);
+    _muxAdcChannel = g_APinDescription[_muxAnalogIn].ulADCChannelNumber;
+    _directAdcChannel = g_APinDescription[_directAnalogIn].ulADCChannelNumber;
+
+    // ADC: hardware trigger on TIOA0, 12 bit, tagged results. Clock and timings are the ones set by the core
+    pmc_enable_periph_clk(ID_ADC);
+    ADC->ADC_MR = (ADC->ADC_MR & ~(ADC_MR_TRGSEL_Msk | ADC_MR_LOWRES | ADC_MR_FREERUN)) | ADC_MR_TRGEN_EN | ADC_MR_TRGSEL_ADC_TRIG1;
+    ADC->ADC_EMR |= ADC_EMR_TAG;
+    armSequence(_sequence);
+    ADC->ADC_RNCR = 0;
+    ADC->ADC_PTCR = ADC_PTCR_RXTEN;
+    ADC->ADC_IDR = 0xFFFFFFFF;
+    ADC->ADC_IER = ADC_IER_ENDRX;
+    NVIC_ClearPendingIRQ(ADC_IRQn);
+    NVIC_SetPriority(ADC_IRQn, POT_ADC_PRIORITY);
+    NVIC_EnableIRQ(ADC_IRQn);
+
+    // TC0 channel 0: TIOA0 cleared on RA, set on RC (rising edge every period). MCK/2 clock.
+    // RA stays below the shortest period
+    _ticksPerUs = VARIANT_MCK / 2 / 1000000;
+    uint32_t rc = _ticksPerUs * settleUs;
+    pmc_set_writeprotect(false);
+    pmc_enable_periph_clk(ID_TC0);
+    TC_Configure(TC0, POT_SCAN_TIMER, TC_CMR_WAVE | TC_CMR_WAVSEL_UP_RC | TC_CMR_TCCLKS_TIMER_CLOCK1 | TC_CMR_ACPA_CLEAR | TC_CMR_ACPC_SET);
+    TC_SetRA(TC0, POT_SCAN_TIMER, rc / 2);
+    TC_SetRC(TC0, POT_SCAN_TIMER, rc);
+    TC_Start(TC0, POT_SCAN_TIMER);
+}
+
+/**
+ * @brief End of a conversion sequence: store the results, arm the next sequence and set its trigger time.
+ *        The counter restarted at the trigger, so the new RC is always ahead of it.
+ *
+ */
+void ADC_Handler(){
+    if(!(ADC->ADC_ISR & ADC_ISR_ENDRX) || _scanner == NULL)   return;
+    uint16_t muxValue = 0, directValue = 0;
+    uint8_t results = (_scanner->getSequence() == (POT_SEQ_MUX | POT_SEQ_DIRECT)) ? 2 : 1;
+    for(uint8_t i=0; i<results; i++){
+        uint8_t channel = _dma[i] >> 12;                // ADC_EMR_TAG: channel number in the 4 MSB
+        if(channel == _muxAdcChannel)       muxValue = _dma[i] & 0x0FFF;
+        if(channel == _directAdcChannel)    directValue = _dma[i] & 0x0FFF;
+    }
+    uint32_t wait = _scanner->storeSample(muxValue, directValue);
+    armSequence(_scanner->getSequence());
+    TC_SetRC(TC0, POT_SCAN_TIMER, _ticksPerUs * wait);
+}
+
+#endif
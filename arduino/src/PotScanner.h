@@ -0,0 +1,93 @@
+#ifndef _POT_SCANNER_H_
+#define _POT_SCANNER_H_
+
+#include <Arduino.h>
+
+#define POT_MUX_CHANNELS    8           // CD4051 inputs
+#define POT_NO_CHANNEL      255         // Pot connected directly to an analog pin
+#define POT_SCAN_TIMER      0           // Timer Counter channel (TC0): only TIOA0-2 can trigger the ADC
+#define POT_ADC_PRIORITY    14          // NVIC priority of the end of conversion interrupt
+#define POT_NO_SAMPLE       0xFFFFFFFF  // Age of a pot not sampled yet
+#define POT_DIRECT          POT_MUX_CHANNELS    // Index of the direct pin in the pot table
+#define POT_NO_INDEX        255
+#define POT_SEQ_MUX         0x01        // Conversion sequence: mux output pin
+#define POT_SEQ_DIRECT      0x02        // Conversion sequence: direct pin
+
+// Adaptive rate: an idle pot is sampled at 20 Hz, a moving one at 500 Hz until it settles
+#define POT_IDLE_PERIOD     50000       // us between two samples of an idle pot
+#define POT_ACTIVE_PERIOD   2000        // us between two samples of a moving pot
+#define POT_ACTIVE_TIME     250000      // us without movement before a pot goes back to idle
+#define POT_MOVE_THR        64          // 12 bit distance between a sample and the filter output that means movement
+
+// Filter: oversampling, one-pole IIR and hysteresis, in fixed point
+#define POT_OVERSAMPLING        4           // Samples summed in a filter input
+#define POT_OVERSAMPLING_BITS   2           // log2(POT_OVERSAMPLING)
+#define POT_IIR_SHIFT           2           // IIR coefficient: 1/2^POT_IIR_SHIFT
+#define POT_IIR_FRAC            8           // Fractional bits of the IIR state (16 bit value)
+#define POT_LEVEL_BITS          12          // Resolution of the output level (volume)
+#define POT_HYSTERESIS          48          // 16 bit units (3 steps of 12 bit): dead band of the level around the filter output
+
+/**
+ * @brief State of a pot. The filter runs in the end of conversion interrupt.
+ *
+ */
+typedef struct {
+    int32_t iir;                // IIR output: 16 bit value << POT_IIR_FRAC
+    uint32_t time;              // micros() of the last sample
+    uint32_t due;               // micros() of the next sample
+    uint32_t moved;             // micros() of the last movement
+    uint16_t raw;               // Last sample (12 bit)
+    uint16_t acc;               // Oversampling accumulator
+    uint16_t level;             // Output level (POT_LEVEL_BITS)
+    uint8_t count;              // Samples in acc
+} PotChannel;
+
+/**
+ * @brief This class acquire the volume pots in background, without blocking analogRead() in the main loop.
+ *        A timer triggers the ADC, which converts the mux output pin and the direct pin in one sequence;
+ *        the PDC writes both results in RAM. At the end of the sequence an interrupt stores them in the
+ *        pot table, selects the next CD4051 input and sets the timer to the next conversion sequence.
+ *        Pots are sampled at an adaptive rate: every POT_IDLE_PERIOD while still, every POT_ACTIVE_PERIOD
+ *        from the first sample that moves (POT_MOVE_THR away from the filter output, or a level change) until
+ *        POT_ACTIVE_TIME without movement. The next sequence converts the mux input due first, selected right
+ *        away so it has at least the settle time to settle, and/or the direct pin, whichever is due. Only
+ *        those pins are converted, and no sequence runs while no pot is due.
+ *        Every sample goes through a fixed point filter: POT_OVERSAMPLING samples are summed, the sum feeds a one-pole
+ *        IIR, and the IIR output is quantized to POT_LEVEL_BITS with hysteresis: the level changes only when the value
+ *        is POT_HYSTERESIS beyond the current step, so a still pot never toggles between levels (up to about +-8 LSB
+ *        of ADC noise). The new level is taken POT_HYSTERESIS behind the value, so a moving pot goes through every
+ *        12 bit level (4096 steps); only a reversal costs the 3 LSB dead band.
+ *        Track::update() reads the filtered level with readLevel(), and can check how old it is with getSampleAge().
+ *        Raw samples (read()) are 12 bit. On the native build a timer callback emulates the acquisition (native/PotScannerNative.cpp).
+ *
+ *        The ADC is owned by the scanner once started: don't use analogRead() anymore.
+ */
+class PotScanner{
+    private:
+        uint8_t _muxAnalogIn, _muxS0, _muxS1, _muxS2, _directAnalogIn;
+        Pio* _selPorts[3];
+        uint32_t _selMasks[3];
+        volatile PotChannel _pots[POT_MUX_CHANNELS + 1];    // Mux inputs, then the direct pin
+        volatile uint16_t _sampled;                     // Bit i: pot i has a filtered level
+        volatile uint8_t _muxChannel;                   // Mux input selected
+        volatile uint8_t _sequence;                     // Pins of the next conversion sequence (POT_SEQ_*)
+        volatile uint32_t _conversions;
+        uint32_t _settleUs;
+        void selectMux(uint8_t channel);
+        void filter(uint8_t index, uint16_t sample, uint32_t now);
+        uint32_t schedule(uint32_t now);
+        uint8_t getIndex(uint8_t analogIn, uint8_t channel);
+
+    public:
+        PotScanner(uint8_t muxAnalogIn, uint8_t muxS0, uint8_t muxS1, uint8_t muxS2, uint8_t directAnalogIn);
+        void start(uint32_t settleUs);
+        uint32_t storeSample(uint16_t muxValue, uint16_t directValue);
+        uint8_t getSequence(){ return _sequence;};
+        uint16_t read(uint8_t analogIn, uint8_t channel);
+        uint16_t readLevel(uint8_t analogIn, uint8_t channel);
+        uint32_t getSampleAge(uint8_t analogIn, uint8_t channel);
+        void serialDebug();
+        uint32_t getConversions();
+};
+
+#endif
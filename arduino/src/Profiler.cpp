@@ -0,0 +1,136 @@
+#include "Profiler.h"
+
+#ifdef PROFILER_ENABLED
+
+ProfilerStats Profiler::_stats[PROFILER_ZONES];
+volatile uint32_t Profiler::_isrCycles = 0;
+const char* const Profiler::_zoneNames[PROFILER_ZONES] = {"Looper::updateDrumpad", "Looper::updateTrackpad", "Looper::scanKeys (ISR)", "Track::update",
+                                                          "TFT::updateMenu", "Looper::changeLedColor", "FastLED.show"};
+
+/**
+ * @brief Enable DWT cycle counter and reset all zones.
+ *
+ */
+void Profiler::init(){
+#ifdef ARDUINO_ARCH_SAM
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+    reset();
+}
+
+/**
+ * @brief Reset statistics of all zones
+ *
+ */
+void Profiler::reset(){
+    noInterrupts();                         // ISR zones record from interrupts
+    memset(_stats, 0, sizeof(_stats));
+    for(uint8_t z=0; z<PROFILER_ZONES; z++){
+        _stats[z].min = UINT32_MAX;
+    }
+    interrupts();
+}
+
+/**
+ * @brief Add a measure to a zone
+ *
+ * @param zone ProfilerZone
+ * @param cycles Measured CPU cycles
+ */
+void Profiler::record(uint8_t zone, uint32_t cycles){
+    ProfilerStats* s = &_stats[zone];
+    s->count++;
+    s->sum += cycles;
+    if(cycles < s->min)  s->min = cycles;
+    if(cycles > s->max)  s->max = cycles;
+    s->buckets[bucketIndex(cycles)]++;
+}
+
+/**
+ * @brief Add a measure to a zone from an interrupt handler. The cycles are also removed from the main loop
+ *        zones running when the interrupt fired (see ProfilerScope).
+ *
+ * @param zone ProfilerZone
+ * @param cycles Measured CPU cycles
+ */
+void Profiler::recordIsr(uint8_t zone, uint32_t cycles){
+    record(zone, cycles);
+    _isrCycles += cycles;
+}
+
+/**
+ * @brief Histogram bucket of a measure.
+ *        Every power of 2 is split in 2^PROFILER_SUB_BUCKETS_BITS linear buckets.
+ *
+ * @param cycles Measured CPU cycles
+ * @return uint8_t Bucket index
+ */
+uint8_t Profiler::bucketIndex(uint32_t cycles){
+    const uint8_t subBuckets = 1 << PROFILER_SUB_BUCKETS_BITS;
+    if(cycles < subBuckets)  return cycles;
+    uint8_t msb = 31 - __builtin_clz(cycles);
+    uint8_t sub = (cycles >> (msb - PROFILER_SUB_BUCKETS_BITS)) & (subBuckets - 1);
+    return ((msb - PROFILER_SUB_BUCKETS_BITS + 1) << PROFILER_SUB_BUCKETS_BITS) + sub;
+}
+
+/**
+ * @brief Biggest value that falls in a bucket
+ *
+ * @param bucket Bucket index
+ * @return uint32_t CPU cycles
+ */
+uint32_t Profiler::bucketUpperBound(uint8_t bucket){
+    const uint8_t subBuckets = 1 << PROFILER_SUB_BUCKETS_BITS;
+    if(bucket < subBuckets)  return bucket;
+    uint8_t msb = (bucket >> PROFILER_SUB_BUCKETS_BITS) + PROFILER_SUB_BUCKETS_BITS - 1;
+    uint8_t sub = bucket & (subBuckets - 1);
+    uint8_t shift = msb - PROFILER_SUB_BUCKETS_BITS;
+    uint32_t lower = (uint32_t)(subBuckets + sub) << shift;
+    return lower + (((uint32_t)1 << shift) - 1);
+}
+
+/**
+ * @brief Get a percentile of a zone. The result is the upper bound of the histogram bucket,
+ *        limited to the max measured value.
+ *
+ * @param zone ProfilerZone
+ * @param p Percentile (1-100)
+ * @return uint32_t CPU cycles
+ */
+uint32_t Profiler::percentile(uint8_t zone, uint8_t p){
+    ProfilerStats* s = &_stats[zone];
+    if(s->count == 0)  return 0;
+    uint32_t target = ((uint64_t)s->count * p + 99) / 100;
+    uint32_t acc = 0;
+    for(uint8_t b=0; b<PROFILER_BUCKETS; b++){
+        acc += s->buckets[b];
+        if(acc >= target){
+            uint32_t bound = bucketUpperBound(b);
+            return bound < s->max ? bound : s->max;
+        }
+    }
+    return s->max;
+}
+
+/**
+ * @brief Serial debug. Print count, min, avg, max and p99 (CPU cycles) of each zone
+ *
+ */
+void Profiler::serialDebug(){
+    for(uint8_t z=0; z<PROFILER_ZONES; z++){
+        ProfilerStats* s = &_stats[z];
+        Serial.print("ZONE "); Serial.print(_zoneNames[z]);
+        Serial.print(" count: "); Serial.print(s->count);
+        if(s->count > 0){
+            Serial.print(" min: "); Serial.print(s->min);
+            Serial.print(" avg: "); Serial.print((uint32_t)(s->sum / s->count));
+            Serial.print(" max: "); Serial.print(s->max);
+            Serial.print(" p99: "); Serial.print(percentile(z, 99));
+        }
+        Serial.println("");
+    }
+}
+
+#endif
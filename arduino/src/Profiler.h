@@ -0,0 +1,105 @@
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#include <Arduino.h>
+#ifndef ARDUINO_ARCH_SAM
+#include "Hal.h"
+#endif
+
+typedef enum {ZONE_UPDATE_DRUMPAD, ZONE_UPDATE_TRACKPAD, ZONE_SCAN_KEYS_ISR, ZONE_TRACK_UPDATE, ZONE_TFT_UPDATE, ZONE_CHANGE_LED_COLOR, ZONE_SHOW_LEDS, PROFILER_ZONES} ProfilerZone;
+
+#define PROFILER_SUB_BUCKETS_BITS  2                                    // 4 buckets for each power of 2: p99 error < 25%
+#define PROFILER_BUCKETS           (32 << PROFILER_SUB_BUCKETS_BITS)
+
+/**
+ * @brief Measure a code zone with the Cortex-M3 DWT cycle counter.
+ *        Use PROFILE_ZONE(zone) at the beginning of a block: the cycles spent until the end of the block
+ *        are added to the zone statistics.
+ *        Use PROFILE_ISR_ZONE(zone) in interrupt handlers: the cycles spent in interrupts are removed from the
+ *        main loop zones they preempted, so an ISR zone is never counted twice.
+ *        Build with -D PROFILER_ENABLED to enable it, otherwise PROFILE_ZONE() is empty and nothing is compiled.
+ */
+#ifdef PROFILER_ENABLED
+
+#define PROFILER_CONCAT_(a, b)  a##b
+#define PROFILER_CONCAT(a, b)   PROFILER_CONCAT_(a, b)
+#define PROFILE_ZONE(zone)      ProfilerScope PROFILER_CONCAT(_profilerScope, __LINE__)(zone)
+#define PROFILE_ISR_ZONE(zone)  ProfilerIsrScope PROFILER_CONCAT(_profilerScope, __LINE__)(zone)
+
+/**
+ * @brief Statistics of a single zone. Timings are in CPU cycles.
+ *
+ */
+typedef struct {
+    uint32_t count;
+    uint32_t min, max;
+    uint64_t sum;
+    uint32_t buckets[PROFILER_BUCKETS];     // Log scaled histogram used for percentiles
+} ProfilerStats;
+
+/**
+ * @brief This class keep cycle statistics (min/avg/max/p99) of each zone in a fixed RAM table.
+ *
+ */
+class Profiler{
+    private:
+        static ProfilerStats _stats[PROFILER_ZONES];
+        static const char* const _zoneNames[PROFILER_ZONES];
+        static volatile uint32_t _isrCycles;    // Cycles spent in ISR zones since init(). Wraps around
+        static uint8_t bucketIndex(uint32_t cycles);
+        static uint32_t bucketUpperBound(uint8_t bucket);
+
+    public:
+        static void init();
+        static void reset();
+        static void record(uint8_t zone, uint32_t cycles);
+        static void recordIsr(uint8_t zone, uint32_t cycles);
+        static inline uint32_t isrCycles(){ return _isrCycles; }
+        static uint32_t percentile(uint8_t zone, uint8_t p);
+        static void serialDebug();
+#ifdef ARDUINO_ARCH_SAM
+        static inline uint32_t cycles(){ return DWT->CYCCNT; }
+#else
+        static inline uint32_t cycles(){ return (uint32_t)(hal::nanos() * 84 / 1000); }     // Host time as 84 MHz cycles
+#endif
+};
+
+/**
+ * @brief Measure cycles from construction to destruction and record them in a Profiler zone
+ *
+ */
+class ProfilerScope{
+    private:
+        uint8_t _zone;
+        uint32_t _start, _isrStart;
+
+    public:
+        inline ProfilerScope(uint8_t zone){ _zone = zone; _isrStart = Profiler::isrCycles(); _start = Profiler::cycles(); }
+        inline ~ProfilerScope(){
+            uint32_t cycles = Profiler::cycles() - _start;
+            Profiler::record(_zone, cycles - (Profiler::isrCycles() - _isrStart));     // Without preempting ISR zones
+        }
+};
+
+/**
+ * @brief Same as ProfilerScope, for a zone inside an interrupt handler
+ *
+ */
+class ProfilerIsrScope{
+    private:
+        uint8_t _zone;
+        uint32_t _start;
+
+    public:
+        inline ProfilerIsrScope(uint8_t zone){ _zone = zone; _start = Profiler::cycles(); }
+        inline ~ProfilerIsrScope(){ Profiler::recordIsr(_zone, Profiler::cycles() - _start); }
+};
+
+#else
+
+#define PROFILE_ZONE(zone)
+#define PROFILE_ISR_ZONE(zone)
+
+#endif
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef _RING_BUFFER_H_
+#define _RING_BUFFER_H_
+
+#include <Arduino.h>
+
+/**
+ * @brief Lock-free single-producer/single-consumer FIFO.
+ *        The producer (e.g. an interrupt) only writes _head, the consumer (main loop) only writes _tail,
+ *        so no interrupt needs to be disabled.
+ *
+ * @tparam T Item type
+ * @tparam SIZE Number of items. Must be a power of 2, not bigger than 128.
+ */
+template <typename T, uint8_t SIZE>
+class RingBuffer{
+    static_assert(SIZE > 0 && SIZE <= 128 && (SIZE & (SIZE - 1)) == 0, "RingBuffer SIZE must be a power of 2 <= 128");
+
+    private:
+        T _items[SIZE];
+        volatile uint8_t _head, _tail;      // Free running indexes
+        volatile uint16_t _dropped;
+
+    public:
+        RingBuffer(){ _head = 0; _tail = 0; _dropped = 0; }
+
+        /**
+         * @brief Add an item. Producer side only.
+         *
+         * @return bool false if the buffer is full (the item is dropped)
+         */
+        bool push(const T& item){
+            uint8_t head = _head;
+            if((uint8_t)(head - _tail) >= SIZE){
+                _dropped = _dropped + 1;
+                return false;
+            }
+            _items[head & (SIZE - 1)] = item;
+            __sync_synchronize();                   // Item must be written before it is published
+            _head = head + 1;
+            return true;
+        }
+
+        /**
+         * @brief Remove the oldest item. Consumer side only.
+         *
+         * @return bool false if the buffer is empty
+         */
+        bool pop(T& item){
+            uint8_t tail = _tail;
+            if(tail == _head)  return false;
+            __sync_synchronize();
+            item = _items[tail & (SIZE - 1)];
+            __sync_synchronize();                   // Item must be read before its slot is released
+            _tail = tail + 1;
+            return true;
+        }
+
+        uint8_t available(){ return (uint8_t)(_head - _tail); }
+        uint16_t getDropped(){ return _dropped; }
+};
+
+#endif
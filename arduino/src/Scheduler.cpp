@@ -0,0 +1,105 @@
+#include "Scheduler.h"
+
+/**
+ * @brief Construct a new Scheduler with no tasks
+ *
+ */
+Scheduler::Scheduler(){
+    _nTasks = 0;
+}
+
+/**
+ * @brief Add a periodic task. The first run is due immediately.
+ *
+ * @param name Task name (used only for debug)
+ * @param callback Function called every period
+ * @param period Task period in microseconds
+ * @param priority When more tasks are due, the one with the highest priority runs first
+ * @return int8_t Task ID, -1 if the task table is full
+ */
+int8_t Scheduler::addTask(const char* name, TaskCallback callback, uint32_t period, TaskPriority priority){
+    if(_nTasks >= SCHEDULER_MAX_TASKS)  return -1;
+    Task* t = &_tasks[_nTasks];
+    t->name = name;
+    t->callback = callback;
+    t->period = period;
+    t->priority = priority;
+    t->nextRun = micros();
+    t->lastDuration = 0;
+    t->maxDuration = 0;
+    t->runs = 0;
+    t->overruns = 0;
+    return _nTasks++;
+}
+
+/**
+ * @brief Run the due task with the highest priority.
+ *        Must be called in the main loop.
+ *        Only one task is executed per call, so high priority tasks are checked again
+ *        between two slower tasks.
+ *        A late task is not run again to catch up: it is rescheduled one period from now.
+ *
+ */
+void Scheduler::run(){
+    uint32_t now = micros();
+    Task* due = NULL;
+    for(uint8_t i=0; i<_nTasks; i++){
+        Task* t = &_tasks[i];
+        if((int32_t)(now - t->nextRun) >= 0){
+            if(due == NULL || t->priority < due->priority)   due = t;
+        }
+    }
+    if(due == NULL)  return;
+
+    uint32_t lateness = now - due->nextRun;
+    due->callback();
+    uint32_t end = micros();
+    due->lastDuration = end - now;
+    if(due->lastDuration > due->maxDuration)    due->maxDuration = due->lastDuration;
+    if(lateness > due->period || due->lastDuration > due->period)   due->overruns++;
+    due->runs++;
+
+    due->nextRun += due->period;
+    if((int32_t)(end - due->nextRun) >= 0)  due->nextRun = end + due->period;   // Skip missed periods
+}
+
+/**
+ * @brief Reset runs, overruns and max duration of all tasks
+ *
+ */
+void Scheduler::resetStats(){
+    for(uint8_t i=0; i<_nTasks; i++){
+        _tasks[i].maxDuration = 0;
+        _tasks[i].runs = 0;
+        _tasks[i].overruns = 0;
+    }
+}
+
+/**
+ * @brief Serial debug. Print runs, overruns, last and max duration (us) of each task
+ *
+ */
+void Scheduler::serialDebug(){
+    for(uint8_t i=0; i<_nTasks; i++){
+        Task* t = &_tasks[i];
+        Serial.print("TASK "); Serial.print(t->name);
+        Serial.print(" period: "); Serial.print(t->period);
+        Serial.print(" runs: "); Serial.print(t->runs);
+        Serial.print(" overruns: "); Serial.print(t->overruns);
+        Serial.print(" last: "); Serial.print(t->lastDuration);
+        Serial.print(" max: "); Serial.print(t->maxDuration);
+        Serial.println("");
+    }
+}
+
+uint8_t Scheduler::getNumberTasks(){
+    return _nTasks;
+}
+
+uint32_t Scheduler::getOverruns(uint8_t taskId){
+    return _tasks[taskId].overruns;
+}
+
+uint32_t Scheduler::getMaxDuration(uint8_t taskId){
+    return _tasks[taskId].maxDuration;
+}
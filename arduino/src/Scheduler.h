@@ -0,0 +1,49 @@
+#ifndef _SCHEDULER_H_
+#define _SCHEDULER_H_
+
+#include <Arduino.h>
+
+#define SCHEDULER_MAX_TASKS 10
+
+typedef enum {PRIORITY_HIGH, PRIORITY_MEDIUM, PRIORITY_LOW} TaskPriority;
+
+typedef void (*TaskCallback)();
+
+/**
+ * @brief A periodic task handled by the Scheduler.
+ *        Timings are in microseconds.
+ */
+typedef struct {
+    const char* name;
+    TaskCallback callback;
+    uint32_t period;
+    TaskPriority priority;
+    uint32_t nextRun;
+    uint32_t lastDuration, maxDuration;
+    uint32_t runs, overruns;
+} Task;
+
+/**
+ * @brief This class run a set of periodic tasks in a cooperative way.
+ *        Every call to run() executes at most one due task: the one with the highest priority.
+ *        A task that can't keep up with its period (started late by more than one period
+ *        or lasting longer than its period) is counted as overrun.
+ *
+ */
+class Scheduler{
+    private:
+        Task _tasks[SCHEDULER_MAX_TASKS];
+        uint8_t _nTasks;
+
+    public:
+        Scheduler();
+        int8_t addTask(const char* name, TaskCallback callback, uint32_t period, TaskPriority priority);
+        void run();
+        void resetStats();
+        void serialDebug();
+        uint8_t getNumberTasks();
+        uint32_t getOverruns(uint8_t taskId);
+        uint32_t getMaxDuration(uint8_t taskId);
+};
+
+#endif
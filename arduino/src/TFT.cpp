@@ -1,5 +1,10 @@
 #include "TFT.h"
+#include "Profiler.h"
 
+// Constant tables: static const, so they stay in flash
+static const char* const MAIN_MENU_ITEMS[] = {"Load Sound", "Apply FX", "Quitta"};
+static const char* const SOUND_MENU_ITEMS[] = {"Crash", "HH", "Kick", "Snare", "Piano", "Organ"};
+static const char* const LATENCY_NAMES[] = {"p50", "p95", "p99"};
 
 /**
  * @brief Construct a new TFT object. 
@@ -10,12 +15,12 @@
  * @param RST Reset pin
  * @param enc Encoder to control TFT menu
  */
-TFT::TFT(uint8_t CS, uint8_t DC, uint8_t RST, Encoder* enc){
+TFT::TFT(uint8_t CS, uint8_t DC, uint8_t RST, Encoder* enc) : _tft(CS, DC, RST){
     _pinCS = CS;
     _pinDC = DC;
     _pinRST = RST;
     _menuEncoder = enc;
-    _tft = new ILI9341_due(_pinCS, _pinDC, _pinRST);
+    _loopStats = NULL;
 }
 
 
@@ -24,15 +29,15 @@ TFT::TFT(uint8_t CS, uint8_t DC, uint8_t RST, Encoder* enc){
  * 
  */
 void TFT::init(){
-  _tft->begin();
-	_tft->setRotation(iliRotation270);
-  _tft->fillScreen(ILI9341_BLACK);
-  _tft->setFont(Arial_14);
+  _tft.begin();
+	_tft.setRotation(iliRotation270);
+  _tft.fillScreen(ILI9341_BLACK);
+  _tft.setFont(Arial_14);
 
   _menuEncoder->init();
   _menuState = MAIN_MENU;
-  _nMenuItems = sizeof(_mainMenu) / sizeof(_mainMenu[0]);
-  _menuPtr = _mainMenu;
+  _nMenuItems = sizeof(MAIN_MENU_ITEMS) / sizeof(MAIN_MENU_ITEMS[0]);
+  _menuPtr = MAIN_MENU_ITEMS;
   drawMenu();
 }
 
@@ -46,32 +51,32 @@ void TFT::init(){
  *                 1: Draw drums
  */
 void TFT::drawInstrument(uint8_t instNum){
-  _tft->fillScreen(ILI9341_BLACK);
+  _tft.fillScreen(ILI9341_BLACK);
   if(instNum == 0){
     //Draw Keys
-    _tft->fillRect(50,70,220,160,ILI9341_AQUA);
+    _tft.fillRect(50,70,220,160,ILI9341_AQUA);
     for(int i=0; i<7; i++){
-      _tft->fillRect((i*30)+60,120,20,100,ILI9341_WHITE);
+      _tft.fillRect((i*30)+60,120,20,100,ILI9341_WHITE);
     }
     for(int i=0; i<6; i++){
-      _tft->fillRect((i*30)+75,120,20,50,ILI9341_BLACK);
+      _tft.fillRect((i*30)+75,120,20,50,ILI9341_BLACK);
       if(i<4){
-        _tft->fillCircle((i*30)+70,90,10,ILI9341_WHITE);
+        _tft.fillCircle((i*30)+70,90,10,ILI9341_WHITE);
       }
     }
   }else if(instNum == 1){
     //Draw Drums
-    _tft->fillRect(50,70,220,160,ILI9341_AQUA);
+    _tft.fillRect(50,70,220,160,ILI9341_AQUA);
     for(int i=0; i<4; i++){
-      _tft->fillRect((i*50)+60,130,40,40,ILI9341_WHITE);
+      _tft.fillRect((i*50)+60,130,40,40,ILI9341_WHITE);
     }
     for(int i=0; i<4; i++){
-      _tft->fillRect((i*50)+60,180,40,40,ILI9341_WHITE);
+      _tft.fillRect((i*50)+60,180,40,40,ILI9341_WHITE);
     }
     for(int i=0; i<4; i++){
-      _tft->fillCircle((i*30)+70,90,10,ILI9341_WHITE);
+      _tft.fillCircle((i*30)+70,90,10,ILI9341_WHITE);
     }
-    _tft->fillRect(180,80,80,20,ILI9341_WHITE);
+    _tft.fillRect(180,80,80,20,ILI9341_WHITE);
   }
 }
 
@@ -80,11 +85,39 @@ void TFT::drawInstrument(uint8_t instNum){
  * 
  * @param newBpm 
  */
-void TFT::drawBpm(String newBpm){
-  _tft->setTextColor(ILI9341_SLATEGRAY);
-  _tft->printAt("BPM:",180,30);  
-  _tft->setTextColor(ILI9341_WHITE);
-  _tft->printAt(newBpm,230,30);  
+void TFT::drawBpm(uint8_t newBpm){
+  char text[4];
+  snprintf(text, sizeof(text), "%u", newBpm);
+  _tft.setTextColor(ILI9341_SLATEGRAY);
+  _tft.printAt("BPM:",180,30);  
+  _tft.setTextColor(ILI9341_WHITE);
+  _tft.printAt(text,230,30);  
+}
+
+/**
+ * @brief Draw pad-to-sound round trip percentiles (ms) under the bpm
+ * 
+ * @param p50 us
+ * @param p95 us
+ * @param p99 us
+ */
+void TFT::drawLatency(uint32_t p50, uint32_t p95, uint32_t p99){
+  char line[24];
+  uint32_t values[3] = {p50, p95, p99};
+  clearLatency();
+  for(uint8_t i=0; i<3; i++){
+    snprintf(line, sizeof(line), "%s: %lu.%lu ms", LATENCY_NAMES[i], (unsigned long)(values[i] / 1000), (unsigned long)(values[i] % 1000) / 100);
+    _tft.setTextColor(ILI9341_SLATEGRAY);
+    _tft.printAt(line, _latencyStartX, _latencyStartY + i * _menuSpacingY);
+  }
+}
+
+/**
+ * @brief Clear latency percentiles
+ * 
+ */
+void TFT::clearLatency(){
+  _tft.fillRect(_latencyStartX, _latencyStartY, TFT_WIDTH - _latencyStartX, 3 * _menuSpacingY, ILI9341_BLACK);
 }
 
 /**
@@ -93,17 +126,23 @@ void TFT::drawBpm(String newBpm){
  * @param p
  */
 void TFT::drawPosition(uint8_t p){
-  uint8_t spacing = 5, nRect = 16;
+  if(p == 0)  fillPosition(0, TFT_POSITION_STEPS - 1, ILI9341_BLACK);   // Reset all
+  else        fillPosition(0, 2*p, ILI9341_WHITE);
+}
+
+/**
+ * @brief Fill steps of the loop position bar
+ * 
+ * @param firstStep 0 to TFT_POSITION_STEPS - 1
+ * @param lastStep 0 to TFT_POSITION_STEPS - 1
+ * @param color
+ */
+void TFT::fillPosition(uint8_t firstStep, uint8_t lastStep, int color){
+  uint8_t spacing = 5, nRect = TFT_POSITION_STEPS;
   uint8_t startX = spacing, startY = 5;
   uint8_t rectW = (uint8_t) (TFT_WIDTH - (nRect*spacing)) / nRect, rectH = 20;
-  int color = ILI9341_WHITE;
-  uint8_t newPos = 2*p;
-  if(newPos==0){                    // Reset all
-    newPos = nRect;
-    color = ILI9341_BLACK;
-  }
-  for(uint8_t i = 0; i<= newPos; i++){
-    _tft->fillRect(startX + i*(rectW+ spacing), startY, rectW, rectH, color);
+  for(uint8_t i = firstStep; i <= lastStep && i < nRect; i++){
+    _tft.fillRect(startX + i*(rectW+ spacing), startY, rectW, rectH, color);
   }
 }
 
@@ -111,7 +150,7 @@ void TFT::drawPosition(uint8_t p){
  * @brief Draw loop tracks on the screen
  * 
  */
-void TFT::drawLoopTrack(Track t){
+void TFT::drawLoopTrack(const Track& t){
   uint16_t inColor = ILI9341_BLACK;
   uint16_t x = t.getX();      uint16_t y = t.getY();
   uint16_t h = t.getHeight(); uint16_t w = t.getWidth();
@@ -139,27 +178,27 @@ void TFT::drawLoopTrack(Track t){
             inColor = ILI9341_GRAY;
             break;
     }
-  _tft->drawRoundRect(x, y , h, w, r, extColor);      // External rect
-  _tft->fillRoundRect(x+2, y+2 , h-4, w-4, r, inColor);   // Inner rect
+  _tft.drawRoundRect(x, y , h, w, r, extColor);      // External rect
+  _tft.fillRoundRect(x+2, y+2 , h-4, w-4, r, inColor);   // Inner rect
   uint16_t circleX = x + w/2; 
   uint16_t circleY = y + h/2;
-  _tft->fillCircle(circleX, circleY, 15, ILI9341_BLACK);       // Black circle in the middle
+  _tft.fillCircle(circleX, circleY, 15, ILI9341_BLACK);       // Black circle in the middle
   if(t.state == STOP_REC){                                     
     uint16_t x0 =  circleX -5; uint16_t y0 = circleY +5;
     uint16_t x1 =  circleX +5; uint16_t y1 = circleY;
     uint16_t x2 =  circleX -5; uint16_t y2 = circleY -5;
-    _tft->fillTriangle(x0, y0, x1, y1, x2, y2, ILI9341_GREEN); // Play symbol
+    _tft.fillTriangle(x0, y0, x1, y1, x2, y2, ILI9341_GREEN); // Play symbol
   }
   else if (t.state == MUTE_REC){
     uint16_t x0 =  circleX - w/2 + 10 ; uint16_t y0 = circleY + h/2 -10;
     uint16_t x1 =  circleX + w/2 -10;  uint16_t y1 = circleY - h/2 + 10;
-    _tft->drawLine(x0, y0, x1, y1, ILI9341_GRAY);
+    _tft.drawLine(x0, y0, x1, y1, ILI9341_GRAY);
   }
   else if(t.state == START_REC){
-    _tft->fillCircle(circleX, circleY, 5, ILI9341_RED);
+    _tft.fillCircle(circleX, circleY, 5, ILI9341_RED);
   }
   else if(t.state == START_OVERDUB){
-    _tft->fillCircle(circleX, circleY, 5, ILI9341_ORANGE);
+    _tft.fillCircle(circleX, circleY, 5, ILI9341_ORANGE);
   }
   
 }
@@ -171,57 +210,87 @@ void TFT::drawLoopTrack(Track t){
  * 
  */
 void TFT::update(){
-    _menuEncoder->updateEncoder();
+    pollEncoder();
     updateMenu();
 }
 
+/**
+ * @brief Read menu encoder switch. Steps (interrupt driven) and presses are kept until the next updateMenu(),
+ *        so it can be called more often than the screen is redrawn.
+ * 
+ */
+void TFT::pollEncoder(){
+    _menuEncoder->updateEncoder();
+}
+
+/**
+ * @brief Set the loop statistics shown in the hidden stats page (encoder long press)
+ * 
+ * @param stats 
+ */
+void TFT::setLoopStats(LoopStats* stats){
+  _loopStats = stats;
+}
+
 void TFT::updateMenu(){
+  PROFILE_ZONE(ZONE_TFT_UPDATE);
+  int16_t steps = _menuEncoder->readSteps();
+  bool pressed = _menuEncoder->readPressed();
+  if(_menuEncoder->readLongPressed() && _loopStats != NULL){                  // Toggle hidden stats page
+    _menuState = (_menuState == STATS_PAGE) ? EXIT : STATS_PAGE;
+  }
   // Draw the index idxow
-  if (_menuEncoder->isMoving()){   
-    if(_menuEncoder->getDirection() == CW)       _selectedItem ++;               // Go down
-    else                                         _selectedItem --;               // Go up
-    if(_selectedItem < 0)                        _selectedItem = _nMenuItems -1;
-    else if(_selectedItem >= _nMenuItems)        _selectedItem = 0;              // Circular motion
+  if (steps != 0 && _menuState != STATS_PAGE){   
+    _selectedItem = (_selectedItem + steps) % _nMenuItems;                     // CW: go down  CCW: go up
+    if(_selectedItem < 0)                        _selectedItem += _nMenuItems;   // Circular motion
     drawMenu();
     _exitMenuTimer = millis();
   }
   switch (_menuState){
     case MAIN_MENU:
-      if (_menuEncoder->isPressed()) {
+      if (pressed) {
         if (_selectedItem == 0)       _menuState = SOUND_MENU;
         else if (_selectedItem == 1)  _menuState = FX_MENU;
         else if (_selectedItem == 2)  _menuState = EXIT;
         _selectedItem = 0;
-        _nMenuItems = sizeof(_soundMenu) / sizeof(_soundMenu[0]);
-        _menuPtr = _soundMenu;
+        _nMenuItems = sizeof(SOUND_MENU_ITEMS) / sizeof(SOUND_MENU_ITEMS[0]);
+        _menuPtr = SOUND_MENU_ITEMS;
         _exitMenuTimer = millis();
       }
       break;
 
     case SOUND_MENU:
-      if (_menuEncoder->isPressed())    _menuState = LOAD_SOUND;
+      if (pressed)                      _menuState = LOAD_SOUND;
       else if(exitMenuForTimeout(5000)) _menuState = EXIT;
       break;
 
     case LOAD_SOUND:
       _menuState = MAIN_MENU;
       _selectedItem = 0;
-      _nMenuItems = sizeof(_mainMenu) / sizeof(_mainMenu[0]);
-      _menuPtr = _mainMenu;
+      _nMenuItems = sizeof(MAIN_MENU_ITEMS) / sizeof(MAIN_MENU_ITEMS[0]);
+      _menuPtr = MAIN_MENU_ITEMS;
       break;
 
     case FX_MENU:
       break;
 
+    case STATS_PAGE:
+      if (pressed)                                                  _menuState = EXIT;
+      else if ((millis() - _statsTimer) > TFT_STATS_REFRESH_TIME)   drawStats();
+      break;
+
     case EXIT:
       _menuState = MAIN_MENU;
       _selectedItem = 0;
-      _nMenuItems = sizeof(_mainMenu) / sizeof(_mainMenu[0]);
-      _menuPtr = _mainMenu;
+      _nMenuItems = sizeof(MAIN_MENU_ITEMS) / sizeof(MAIN_MENU_ITEMS[0]);
+      _menuPtr = MAIN_MENU_ITEMS;
       break;
   }
   
-  if(_menuState != _oldMenuState)    drawMenu();  // Force update
+  if(_menuState != _oldMenuState){                // Force update
+    if(_menuState == STATS_PAGE)    drawStats();
+    else                            drawMenu();
+  }
   _oldMenuState = _menuState;
 
 }
@@ -229,7 +298,7 @@ void TFT::updateMenu(){
 
 void TFT::clearMenu(){
    uint8_t sX = 30, sY = 20;
-   _tft->fillRect(_menuStartX-sX, _menuStartY-sY, _menuW+sX, _menuSpacingY * _maxItemToShow + sX, ILI9341_BLACK);
+   _tft.fillRect(_menuStartX-sX, _menuStartY-sY, _menuW+sX, _menuSpacingY * _maxItemToShow + sX, ILI9341_BLACK);
 }
 
 void TFT::drawMenu(){ 
@@ -243,17 +312,35 @@ void TFT::drawMenu(){
   // Draw the menu
   for (uint8_t i = _scrollIndex; i < _nMenuItems; i++){
     if(i < (_maxItemToShow+_scrollIndex)){
-       _tft->setTextColor(ILI9341_WHITE);  
+       _tft.setTextColor(ILI9341_WHITE);  
        if( i == _selectedItem){
-          _tft->setTextColor(ILI9341_RED);  
+          _tft.setTextColor(ILI9341_RED);  
        }      
-      _tft->printAt(_menuPtr[i], _menuStartX, _menuStartY + (i-_scrollIndex) * _menuSpacingY);
+      _tft.printAt(_menuPtr[i], _menuStartX, _menuStartY + (i-_scrollIndex) * _menuSpacingY);
     }
   }
   // Draw navbar
   drawNavBar();
 }
 
+/**
+ * @brief Draw main loop statistics in the menu area: worst loop period, p99 loop period
+ *        and worst time between two keypad scans (us)
+ * 
+ */
+void TFT::drawStats(){
+  char line[32];
+  clearMenu();
+  _tft.setTextColor(ILI9341_WHITE);
+  snprintf(line, sizeof(line), "Loop max: %lu", (unsigned long)_loopStats->getMaxPeriod());
+  _tft.printAt(line, _menuStartX, _menuStartY);
+  snprintf(line, sizeof(line), "Loop p99: %lu", (unsigned long)_loopStats->percentile(99));
+  _tft.printAt(line, _menuStartX, _menuStartY + _menuSpacingY);
+  snprintf(line, sizeof(line), "Scan gap: %lu", (unsigned long)_loopStats->getMaxScanGap());
+  _tft.printAt(line, _menuStartX, _menuStartY + 2 * _menuSpacingY);
+  _statsTimer = millis();
+}
+
 void TFT::drawNavBar(){
     uint8_t width = 8, r = 3 , b = width, h = 8;
     uint8_t spacer = 3;
@@ -269,23 +356,23 @@ void TFT::drawNavBar(){
       x0 = firstPointX;  y0 = firstPointY - spacer;
       x1 = x0 + b/2;     y1 = y0 - h;
       x2 = x0 +b;        y2 = y0;
-      _tft->fillTriangle(x0,y0,x1,y1,x2,y2, color);   
+      _tft.fillTriangle(x0,y0,x1,y1,x2,y2, color);   
     }
     
     // External navbar
-    _tft->drawRoundRect(firstPointX, firstPointY, width, _maxItemToShow *_menuSpacingY, r, color); 
+    _tft.drawRoundRect(firstPointX, firstPointY, width, _maxItemToShow *_menuSpacingY, r, color); 
 
     //Inner navbar depending on selected items
     uint8_t navHeigth = (_maxItemToShow *_menuSpacingY) / _nMenuItems;
     uint8_t navPosY = firstPointY +_selectedItem * navHeigth - 1;
-    _tft->fillRoundRect(firstPointX+1, navPosY, width-2, navHeigth, r, color);    
+    _tft.fillRoundRect(firstPointX+1, navPosY, width-2, navHeigth, r, color);    
 
     // Down triangle
     if(_nMenuItems > _maxItemToShow && _selectedItem != (_nMenuItems-1)){
       x0 = firstPointX; y0 = firstPointY + _maxItemToShow *_menuSpacingY + spacer;
       x1 = x0 + b/2;    y1 = y0 + h;
       x2 = x0 +b;       y2 = y0;
-      _tft->fillTriangle(x0,y0,x1,y1,x2,y2, color);   
+      _tft.fillTriangle(x0,y0,x1,y1,x2,y2, color);   
     }
 }
 
@@ -6,12 +6,15 @@
 #include "Encoder.h"
 #include "Arial14.h"
 #include "Track.h"
+#include "LoopStats.h"
 
 #define TFT_WIDTH   320
 #define TFT_HEIGHT  240
+#define TFT_POSITION_STEPS  16      // Rectangles of the loop position bar
+#define TFT_STATS_REFRESH_TIME  500     // ms
 
 
-typedef enum {MAIN_MENU, SOUND_MENU, LOAD_SOUND, FX_MENU, EXIT}MenuState;
+typedef enum {MAIN_MENU, SOUND_MENU, LOAD_SOUND, FX_MENU, STATS_PAGE, EXIT}MenuState;
 
 /**
  * @brief This class control a TFT screeen based on ILI9341 chip.
@@ -21,39 +24,45 @@ typedef enum {MAIN_MENU, SOUND_MENU, LOAD_SOUND, FX_MENU, EXIT}MenuState;
 class TFT{
     private:
         uint8_t _pinCS, _pinDC, _pinRST;
-        ILI9341_due* _tft;
+        ILI9341_due _tft;                                           // Statically placed with its DMA scanline buffer
         Encoder *_menuEncoder;
+        LoopStats *_loopStats;
         
 
         // Menu
-        unsigned long _exitMenuTimer;
+        unsigned long _exitMenuTimer, _statsTimer;
         int8_t _selectedItem;
         uint8_t _menuState, _oldMenuState, _nMenuItems;
         uint8_t _scrollIndex;
         const uint8_t _maxItemToShow = 3;
-        const char* _mainMenu[3] = {"Load Sound", "Apply FX", "Quitta"}; 
-        const char* _soundMenu[6] = {"Crash", "HH", "Kick", "Snare", "Piano", "Organ"}; 
-        const char** _menuPtr;
+        const char* const* _menuPtr;                                // MAIN_MENU_ITEMS or SOUND_MENU_ITEMS (flash)
 
         // Graphics
         const uint8_t _menuH = 20,  _menuW = 100;                   // Index backlight Heigth, Width dimensions
         const uint8_t _menuStartX = 40, _menuStartY = 50;
         const uint8_t _menuSpacingY = 20;
+        const uint16_t _latencyStartX = 180, _latencyStartY = 50;
 
     public:
         TFT(uint8_t CS, uint8_t DC, uint8_t RST, Encoder* enc);
         void init();
         void drawInstrument(uint8_t instNum);
         void update();
+        void pollEncoder();
         void updateMenu();
         void drawMenu();
+        void drawStats();
+        void drawLatency(uint32_t p50, uint32_t p95, uint32_t p99);
+        void clearLatency();
+        void setLoopStats(LoopStats* stats);
         void drawNavBar();
         void clearMenu();
-        void drawBpm(String newBpm);
+        void drawBpm(uint8_t newBpm);
         void drawPosition(uint8_t p);
+        void fillPosition(uint8_t firstStep, uint8_t lastStep, int color);
         unsigned long testText(); 
         unsigned long testLines(uint16_t color);
-        void drawLoopTrack(Track t);
+        void drawLoopTrack(const Track& t);
         bool loadSound();
         bool exitMenuForTimeout(unsigned long timeout);
         uint8_t getSelectedItem();        
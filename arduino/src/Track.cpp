@@ -1,4 +1,6 @@
 #include "Track.h"
+#include "Profiler.h"
+#include "InputTrace.h"
 
 
 Track::Track(uint8_t id, uint8_t analogIn, uint8_t muxS0, uint8_t muxS1, uint8_t muxS2, bool muxIsUsed){
@@ -8,22 +10,87 @@ Track::Track(uint8_t id, uint8_t analogIn, uint8_t muxS0, uint8_t muxS1, uint8_t
     _muxS1 = muxS1;
     _muxS2 = muxS2;
     _muxIsUsed = muxIsUsed;
+    _potScanner = NULL;
 }
 
 
 void Track::init(){
     pinMode(_analogIn, INPUT);
+    analogReadResolution(12);
     if(_muxIsUsed){
         pinMode(_muxS0, OUTPUT);
         pinMode(_muxS1, OUTPUT);
         pinMode(_muxS2, OUTPUT);
     }
     state = CLEAR_REC;
+    _confirmedState = CLEAR_REC;
+    _pendingPredictions = 0;
+    _predictionTime = 0;
     _volume = 0;
 }
 
 
-bool Track::update(){
+/**
+ * @brief Show a predicted state until Pd answers the message just sent
+ *
+ * @param predicted State Pd is expected to report
+ * @param now micros()
+ */
+void Track::predictState(TrackState predicted, uint32_t now){
+    state = predicted;
+    if(_pendingPredictions < 255)   _pendingPredictions++;
+    _predictionTime = now;
+}
+
+
+/**
+ * @brief State received from Pd. It answers the oldest pending prediction: while newer predictions
+ *        are pending the predicted state is kept, otherwise Pd's state is shown (rollback if the prediction was wrong).
+ *
+ * @param newState State reported by Pd
+ * @return bool True if the shown state changed
+ */
+bool Track::confirmState(TrackState newState){
+    TrackState shown = state;
+    _confirmedState = newState;
+    if(_pendingPredictions > 0)     _pendingPredictions--;
+    if(_pendingPredictions == 0)    state = newState;
+    return state != shown;
+}
+
+
+/**
+ * @brief Roll back to Pd's state if a prediction has not been answered within STATE_PREDICTION_TIMEOUT
+ *        (message lost, or ignored by Pd)
+ *
+ * @param now micros()
+ * @return bool True if the shown state changed
+ */
+bool Track::expirePrediction(uint32_t now){
+    if(_pendingPredictions == 0 || now - _predictionTime < STATE_PREDICTION_TIMEOUT)   return false;
+    TrackState shown = state;
+    _pendingPredictions = 0;
+    state = _confirmedState;
+    return state != shown;
+}
+
+
+/**
+ * @brief Read the volume pot from the table of a PotScanner instead of converting it in update()
+ *
+ * @param potScanner Background acquisition of the pots, NULL to use analogRead()
+ */
+void Track::setPotScanner(PotScanner* potScanner){
+    _potScanner = potScanner;
+}
+
+
+/**
+ * @brief Select the mux input of the track and convert the pot (blocking)
+ *
+ * @return int 12 bit value
+ */
+int Track::readPot(){
     if(_muxIsUsed){
         uint32_t s2 = LOW, s1= LOW, s0= LOW;
         switch(_id){
@@ -40,12 +107,26 @@ bool Track::update(){
         digitalWrite(_muxS1, s1);
         digitalWrite(_muxS2, s2);
     }
-    uint8_t actualVolume = map(analogRead(_analogIn),0, 1023, 0, 255);
-    if((actualVolume <= (_volume + VOLUME_THR)) && (actualVolume >= (_volume - VOLUME_THR)))  _volumeChanged = false; // Significative change
-    else  {
-        _volumeChanged = true;
-        _volume = actualVolume;
+    int raw = analogRead(_analogIn);
+    TRACE_ANALOG(_analogIn, _muxIsUsed ? _id : TRACE_NO_CHANNEL, raw);
+    return raw;
+}
+
+
+bool Track::update(){
+    PROFILE_ZONE(ZONE_TRACK_UPDATE);
+    uint16_t actualVolume;
+    if(_potScanner != NULL){
+        uint8_t channel = _muxIsUsed ? _id : POT_NO_CHANNEL;
+        if(_potScanner->getSampleAge(_analogIn, channel) > VOLUME_MAX_SAMPLE_AGE)    return false;
+        actualVolume = _potScanner->readLevel(_analogIn, channel);                          // Filtered, with hysteresis
+        _volumeChanged = (actualVolume != _volume);
+    }
+    else{
+        actualVolume = readPot();
+        _volumeChanged = !((actualVolume <= (_volume + VOLUME_THR)) && (actualVolume >= (_volume - VOLUME_THR)));  // Significative change
     }
+    if(_volumeChanged)  _volume = actualVolume;
     return _volumeChanged;
 }
 
@@ -60,7 +141,7 @@ void Track::setGraphics(uint16_t xStart,uint16_t yStart,uint16_t height, uint16_
 
 
 void Track::serialDebug(){
-    String msg = "";
+    const char* msg = "";
     switch(state){
         case CLEAR_REC:         msg = "CLEAR_REC";  break;
         case START_REC:         msg = "START_REC"; break;
@@ -2,32 +2,50 @@
 #define _TRACK_H_
 
 #include <Arduino.h>
-#define VOLUME_THR 10
+#include "PotScanner.h"
+#define VOLUME_THR 48                       // 12 bit. Without PotScanner (its levels are filtered, with hysteresis)
+#define VOLUME_MAX_SAMPLE_AGE 100000        // us. Older pot samples are ignored (acquisition not running)
+#define STATE_PREDICTION_TIMEOUT 300000     // us. A predicted state not confirmed by Pd within this time is rolled back
 
 typedef enum {CLEAR_REC, START_REC, STOP_REC, START_OVERDUB, STOP_OVERDUB, WAIT_REC, MUTE_REC}  TrackState;
 
 class Track{
     private:
-        uint8_t _id, _analogIn, _volume;
+        uint8_t _id, _analogIn;
+        uint16_t _volume;                                       // 12 bit
         bool _volumeChanged, _muxIsUsed;
         uint8_t _muxS0, _muxS1, _muxS2;
         uint16_t _xStart, _yStart, _height, _width, _radius;     // Graphic dimension to display a rectangle on screen
         uint16_t _color;
+        PotScanner* _potScanner;
+        TrackState _confirmedState;                             // Last state received from Pd
+        uint8_t _pendingPredictions;                            // Predictions not yet answered by Pd
+        uint32_t _predictionTime;
+        int readPot();
     public:
-        TrackState state;
+        TrackState state;                                       // Shown state: Pd's one, or the predicted one until Pd answers
         Track(uint8_t id, uint8_t analogIn, uint8_t muxS0, uint8_t muxS1, uint8_t muxS2, bool muxIsUsed);
         void setGraphics(uint16_t xStart,uint16_t yStart,uint16_t height, uint16_t width, uint16_t radius, uint16_t color);
         void init();
+        void setPotScanner(PotScanner* potScanner);
         bool update();
+        void predictState(TrackState predicted, uint32_t now);
+        bool confirmState(TrackState newState);
+        bool expirePrediction(uint32_t now);
+        TrackState getConfirmedState() const{ return _confirmedState;};
         void serialDebug();
-        uint8_t getId(){return _id;};
-        uint8_t getVolume(){ return _volume;};
-        uint16_t getX(){ return _xStart;};
-        uint16_t getY(){ return _yStart;};
-        uint16_t getHeight(){ return _height;};
-        uint16_t getWidth(){ return _width;};
-        uint16_t getRadius(){ return _radius;};
-        uint16_t getColor(){ return _color;}
+        uint8_t getId() const{return _id;};
+        uint16_t getVolume() const{ return _volume;};
+        uint16_t getX() const{ return _xStart;};
+        uint16_t getY() const{ return _yStart;};
+        uint16_t getHeight() const{ return _height;};
+        uint16_t getWidth() const{ return _width;};
+        uint16_t getRadius() const{ return _radius;};
+        uint16_t getColor() const{ return _color;}
+        uint8_t getAnalogIn() const{ return _analogIn;};
+        uint8_t getMuxS0() const{ return _muxS0;};
+        uint8_t getMuxS1() const{ return _muxS1;};
+        uint8_t getMuxS2() const{ return _muxS2;};
 };
 
 #endif
\ No newline at end of file
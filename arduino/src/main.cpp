@@ -16,6 +16,15 @@
 #include "Encoder.h"
 #include "Track.h"
 #include "TFT.h"
+#include "Scheduler.h"
+#include "Profiler.h"
+#include "HwTimer.h"
+#include "LoopStats.h"
+#include "InputTrace.h"
+#include "LatencyMeter.h"
+#include "BeatClock.h"
+#include "PotScanner.h"
+#include "HeapWatch.h"
 
 /*** SERIAL CONFIG ***/
 #define SR0_BAUD_RATE             115200      // Serial 0 used for debug
@@ -25,10 +34,12 @@
 /*** DRUM PAD CONFIG ***/
 #define DRUM_PAD_ROWS 4 //four rows
 #define DRUM_PAD_COLS 4 //four columns
-uint8_t drumRowPins[DRUM_PAD_ROWS] = {9, 8, 7, 6};  //connect to the row pinouts of the keypad
-uint8_t drumColPins[DRUM_PAD_COLS] = {5, 4, 3, 2};  //connect to the column pinouts of the keypad
-uint8_t drumpadKeyId[DRUM_PAD_ROWS * DRUM_PAD_COLS] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15}; //Assign key id .Start from (0,0) ... (0,1)
-uint8_t drumpadLedId[DRUM_PAD_ROWS * DRUM_PAD_COLS] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15}; //Assign key id .Start from (0,0) ... (0,1)
+extern constexpr KeypadConfig<DRUM_PAD_ROWS, DRUM_PAD_COLS> drumpadConfig = {
+  {9, 8, 7, 6},                                               //connect to the row pinouts of the keypad
+  {5, 4, 3, 2},                                               //connect to the column pinouts of the keypad
+  {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},     //Assign key id .Start from (0,0) ... (0,1)
+  {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15}      //Assign led id .Start from (0,0) ... (0,1)
+};
 
 /*** TRACK PAD CONFIG ***/
 #define TRACK_PAD_ROWS 2 //four rows
@@ -39,16 +50,30 @@ uint8_t drumpadLedId[DRUM_PAD_ROWS * DRUM_PAD_COLS] = {0, 1, 2, 3, 4, 5, 6, 7, 8
 #define TRACK_VOL_MUX_S2    52
 #define MASTER_VOL_ANALOG_IN A1
 
-uint8_t trackRowPins[TRACK_PAD_ROWS] = {27, 26}; //connect to the row pinouts of the keypad
-uint8_t trackColPins[TRACK_PAD_COLS] = {25, 24, 23, 22};//connect to the column pinouts of the keypad
-uint8_t trackpadKeyId[TRACK_PAD_ROWS * TRACK_PAD_COLS] = {16, 17, 18, 19, 20, 21, 22, 23}; //Assign key id .Start from (0,0) ... (0,1)
-uint8_t trackpadLedId[TRACK_PAD_ROWS * TRACK_PAD_COLS] = {16, 17, 18, 19, 20, 21, 22, 23}; //Assign led id .Start from (0,0) ... (0,1)
+extern constexpr KeypadConfig<TRACK_PAD_ROWS, TRACK_PAD_COLS> trackpadConfig = {
+  {27, 26},                                                   //connect to the row pinouts of the keypad
+  {25, 24, 23, 22},                                           //connect to the column pinouts of the keypad
+  {16, 17, 18, 19, 20, 21, 22, 23},                           //Assign key id .Start from (0,0) ... (0,1)
+  {16, 17, 18, 19, 20, 21, 22, 23}                            //Assign led id .Start from (0,0) ... (0,1)
+};
 
 /*** BUTTONS CONFIG ***/
 #define MUTE_KEY_ID     24
 #define MUTE_KEY_PIN    31
 #define MUTE_KEY_LED_ID 24  
 
+/*** KEY ROLES ***/
+// Action of each key id (drum pad 0-15, track pad 16-23). Remap the layout here.
+#define KEY_ROLES_SIZE  (DRUM_PAD_ROWS * DRUM_PAD_COLS + TRACK_PAD_ROWS * TRACK_PAD_COLS)
+constexpr KeyRole keyRoles[KEY_ROLES_SIZE] = {
+  {KEY_DRUM_HIT, 0}, {KEY_DRUM_HIT, 1}, {KEY_DRUM_HIT, 2},  {KEY_DRUM_HIT, 3},      // Drum pad: sounds 1-12
+  {KEY_DRUM_HIT, 4}, {KEY_DRUM_HIT, 5}, {KEY_DRUM_HIT, 6},  {KEY_DRUM_HIT, 7},
+  {KEY_DRUM_HIT, 8}, {KEY_DRUM_HIT, 9}, {KEY_DRUM_HIT, 10}, {KEY_DRUM_HIT, 11},
+  {KEY_LOOP, 0},     {KEY_LOOP, 1},     {KEY_LOOP, 2},      {KEY_LOOP, 3},          // Drum pad last row: loop tracks 1-4
+  {KEY_LOOP, 0},     {KEY_LOOP, 1},     {KEY_LOOP, 2},      {KEY_LOOP, 3},          // Track pad: loop tracks 1-8
+  {KEY_LOOP, 4},     {KEY_LOOP, 5},     {KEY_LOOP, 6},      {KEY_LOOP, 7}
+};
+
 /*** LED CONFIG ***/
 #define NUM_LEDS 24
 #define LED_DATA_PIN 11
@@ -65,11 +90,32 @@ uint8_t trackpadLedId[TRACK_PAD_ROWS * TRACK_PAD_COLS] = {16, 17, 18, 19, 20, 21
 #define TFT_CS    42
 #define TFT_RST   41
 
+/*** SCHEDULER CONFIG ***/
+#define KEYPAD_TASK_PERIOD    1000        // us (1 kHz)
+#define BUTTONS_TASK_PERIOD   1000        // us (1 kHz) mute key and encoder switch
+#define SERIAL_TASK_PERIOD    1000        // us (1 kHz) messages from Raspberry
+#define POTS_TASK_PERIOD      10000       // us (100 Hz)
+#define VOLUMES_TASK_PERIOD   20000       // us (50 Hz) changed volumes sent to Raspberry
+#define LEDS_TASK_PERIOD      16667       // us (60 Hz)
+#define TFT_TASK_PERIOD       33333       // us (30 Hz)
+#define DEBUG_TASK_PERIOD     100000      // us (10 Hz) commands on debug serial
+#define TRACE_TASK_PERIOD     1000        // us (1 kHz) input trace sent on debug serial
+
+/*** KEYPAD SCAN ***/
+#define KEYPAD_SCAN_ISR         1                       // 1: keypads scanned by timer interrupt  0: keypads scanned by keypad task
+#define KEYPAD_SCAN_TIMER       3                       // Timer Counter channel (TC3)
+#define KEYPAD_SCAN_PERIOD      KEYPAD_SCAN_INTERVAL    // us
+
+/*** POTS ACQUISITION ***/
+#define POT_SETTLE_TIME         500                     // us between a mux switch and the conversion of its input (shortest sequence period)
+
+/*** LOOP POSITION ***/
+#define BEAT_TIMER              4                       // Timer Counter channel (TC4) of the position steps between bar syncs
 
 
 // Looper object
-Keypad drumpadKeypad = Keypad( drumpadKeyId, drumpadLedId, drumRowPins, drumColPins, DRUM_PAD_ROWS, DRUM_PAD_COLS );
-Keypad trackpadKeypad = Keypad( trackpadKeyId, trackpadLedId, trackRowPins, trackColPins, TRACK_PAD_ROWS, TRACK_PAD_COLS );
+Keypad<DRUM_PAD_ROWS, DRUM_PAD_COLS> drumpadKeypad(drumpadConfig);
+Keypad<TRACK_PAD_ROWS, TRACK_PAD_COLS> trackpadKeypad(trackpadConfig);
 Key muteKey = Key(MUTE_KEY_ID, MUTE_KEY_PIN, MUTE_KEY_LED_ID);
 CRGB leds[NUM_LEDS];
 Encoder menuEncoder = Encoder(ENC_PIN_CLK, ENC_PIN_DT, ENC_PIN_SW, ENC_PPR, ENC_PPR_DIVIDER);
@@ -85,16 +131,117 @@ Track loopTracks[] ={Track(0, TRACK_VOL_ANALOG_IN, TRACK_VOL_MUX_S0, TRACK_VOL_M
 
 Track loopMaster =  Track(9, MASTER_VOL_ANALOG_IN, 0, 0, 0, false);
 
-Looper looper = Looper(&drumpadKeypad, &trackpadKeypad, loopTracks, &loopMaster, &tft, leds, &muteKey, &Serial1, SERIAL_TO_PI_BAUD_RATE); 
+Looper looper = Looper(&drumpadKeypad, &trackpadKeypad, loopTracks, &loopMaster, &tft, leds, &muteKey, keyRoles, KEY_ROLES_SIZE, &Serial1, SERIAL_TO_PI_BAUD_RATE); 
+Scheduler scheduler;
+LoopStats loopStats = LoopStats(&drumpadKeypad, &trackpadKeypad);
+LatencyMeter latencyMeter;
+BeatClock beatClock = BeatClock(BEAT_TIMER);
+HwTimer keyScanTimer = HwTimer(KEYPAD_SCAN_TIMER);
+PotScanner potScanner(TRACK_VOL_ANALOG_IN, TRACK_VOL_MUX_S0, TRACK_VOL_MUX_S1, TRACK_VOL_MUX_S2, MASTER_VOL_ANALOG_IN);
+
+
+// Keypad scan interrupt
+void keyScanIsr()   { looper.scanKeys(); }
+
+// Scheduler tasks
+void keypadTask()   { looper.updateKeys(); }
+void buttonsTask()  { looper.updateMuteKey(); looper.updateEncoder(); }
+void serialTask()   { looper.getDataFromPi(); }
+void potsTask()     { looper.updateVolumes(); }
+void volumesTask()  { looper.flushVolumes(); }
+void ledsTask()     { looper.expirePredictions(); looper.showLeds(); }
+void tftTask()      { looper.updateMenu(); looper.updateLatency(); looper.updatePosition(); }
+#ifdef TRACE_ENABLED
+void traceTask()    { InputTrace::flush(); }
+#endif
+
+/**
+ * @brief Handle single char commands received on debug serial (SR0).
+ *          s: print scheduler tasks statistics
+ *          p: print profiler zones statistics (build with -D PROFILER_ENABLED)
+ *          l: print main loop period histogram and worst keypad scan gap
+ *          v: print pots values and sample age
+ *          m: start/stop pad-to-sound latency measure (shown on TFT) and print its statistics
+ *          h: print heap allocations and heap growth since the end of setup()
+ *          r: reset statistics
+ *          t: start/stop input trace (build with -D TRACE_ENABLED). While tracing the debug serial only carries the trace:
+ *             the other commands are ignored
+ */
+void debugTask(){
+  while(Serial.available() > 0){
+    char command = Serial.read();
+#ifdef TRACE_ENABLED
+    if(InputTrace::isRunning() && command != 't')   continue;    // Text reports would corrupt the binary trace records
+#endif
+    switch(command){
+      case 's':
+        scheduler.serialDebug();
+        Serial.print("KEY EVENTS dropped: "); Serial.println(looper.getDroppedKeyEvents());
+        break;
+#ifdef PROFILER_ENABLED
+      case 'p': Profiler::serialDebug(); break;
+#endif
+      case 'l': loopStats.serialDebug(); break;
+      case 'v': potScanner.serialDebug(); break;
+      case 'h': HeapWatch::serialDebug(); break;
+      case 'm':
+        latencyMeter.setEnabled(!latencyMeter.isEnabled());
+        latencyMeter.serialDebug();
+        break;
+#ifdef TRACE_ENABLED
+      case 't':
+        if(InputTrace::isRunning())   InputTrace::stop();
+        else                          InputTrace::start();
+        break;
+#endif
+      case 'r':
+        scheduler.resetStats();
+        loopStats.reset();
+        latencyMeter.reset();
+#ifdef PROFILER_ENABLED
+        Profiler::reset();
+#endif
+        break;
+    }
+  }
+}
 
 
 void setup() {
   Serial.begin(SR0_BAUD_RATE);
+#ifdef PROFILER_ENABLED
+  Profiler::init();
+#endif
   FastLED.addLeds<NEOPIXEL, LED_DATA_PIN>(leds, NUM_LEDS);  // GRB ordering is assumed
+  tft.setLoopStats(&loopStats);
+  looper.setLatencyMeter(&latencyMeter);
+  looper.setBeatClock(&beatClock);
   looper.init();
+
+  for(uint8_t i=0; i<TRACK_PAD_ROWS * TRACK_PAD_COLS; i++)   loopTracks[i].setPotScanner(&potScanner);
+  loopMaster.setPotScanner(&potScanner);
+  potScanner.start(POT_SETTLE_TIME);
+
+#if KEYPAD_SCAN_ISR
+  looper.enableKeyScanIsr();
+  keyScanTimer.start(KEYPAD_SCAN_PERIOD, keyScanIsr);
+#endif
+
+  scheduler.addTask("keypad",  keypadTask,  KEYPAD_TASK_PERIOD,  PRIORITY_HIGH);
+  scheduler.addTask("buttons", buttonsTask, BUTTONS_TASK_PERIOD, PRIORITY_HIGH);
+  scheduler.addTask("serial",  serialTask,  SERIAL_TASK_PERIOD,  PRIORITY_HIGH);
+  scheduler.addTask("pots",    potsTask,    POTS_TASK_PERIOD,    PRIORITY_MEDIUM);
+  scheduler.addTask("volumes", volumesTask, VOLUMES_TASK_PERIOD, PRIORITY_MEDIUM);
+  scheduler.addTask("leds",    ledsTask,    LEDS_TASK_PERIOD,    PRIORITY_MEDIUM);
+  scheduler.addTask("tft",     tftTask,     TFT_TASK_PERIOD,     PRIORITY_LOW);
+  scheduler.addTask("debug",   debugTask,   DEBUG_TASK_PERIOD,   PRIORITY_LOW);
+#ifdef TRACE_ENABLED
+  scheduler.addTask("trace",   traceTask,   TRACE_TASK_PERIOD,   PRIORITY_LOW);
+#endif
+  HeapWatch::arm();                                         // From now on, no allocation
 }
 
 void loop() {
-  looper.getDataFromPi();
-  looper.update();
+  loopStats.recordLoop();
+  scheduler.run();
 }
\ No newline at end of file
@@ -0,0 +1,178 @@
+"""
+Replay regression tests: small input traces run through the firmware on the host (env:replay),
+checked against the bytes sent to the Raspberry.
+
+    python test/replay/replay_test.py .pio/build/replay/program             check every scenario
+    python test/replay/replay_test.py .pio/build/replay/program --update    rewrite the expected .tx files
+    python test/replay/replay_test.py --generate                            rewrite the .trace files
+
+Each scenario is a <name>.trace (input trace, same format as env:due_trace, see src/InputTrace.h)
+and a <name>.tx (exact Serial1 stream expected from the firmware). The traces are generated by the
+functions below, so what they press and turn can be read here. Besides the exact bytes, the decoded
+messages (channel, id) must match EXPECTED: a change of timing shows up as a .tx diff, a change of
+behavior as a message diff.
+"""
+import os
+import struct
+import subprocess
+import sys
+import tempfile
+
+DIR = os.path.dirname(os.path.abspath(__file__))
+
+TRACE_MAGIC = b"PLTR"
+TRACE_VERSION = 1
+TRACE_ANALOG_BITS = 12
+REC_DIGITAL, REC_MATRIX, REC_ANALOG, REC_SERIAL, REC_END = range(5)
+
+MSG_TIMESTAMP_FLAG = 0x80
+MSG_WIDE_FLAG = 0x40
+CHANNELS = ["AUDIO_MASTER", "DRUMPAD_SOUND", "BTN_PRESSED", "CLEAR_LOOP", "CLEAR_ALL", "OVERDUB",
+            "AUDIO_INPUT", "LOOP_PRESSED", "VOLUME"]
+
+# Pins of src/main.cpp
+DRUM_ROWS, DRUM_COLS = (9, 8, 7, 6), (5, 4, 3, 2)
+TRACK_ROWS, TRACK_COLS = (27, 26), (25, 24, 23, 22)
+ENC_CLK, ENC_DT, ENC_SW = 28, 29, 30
+
+MS = 1000
+START = 1000                    # us. Time of the first record
+
+
+class Trace:
+    def __init__(self):
+        self.records = []
+
+    def digital(self, t, pin, value):
+        self.records.append((START + t, REC_DIGITAL, pin, 0, value))
+
+    def key(self, t, row, col, pressed):
+        self.records.append((START + t, REC_MATRIX, row, col, 1 if pressed else 0))
+
+    def bounce(self, t, row, col, pressed, period=1100, count=15):
+        """Contact bounce, then the final level"""
+        for i in range(count):
+            self.key(t + i * period, row, col, (i % 2 == 0) == pressed)
+        return t + count * period
+
+    def detent(self, t, cw=True, period=5 * MS):
+        """One detent: 4 quadrature transitions from the rest state (CLK and DT high)"""
+        states = [(0, 1), (0, 0), (1, 0), (1, 1)] if cw else [(1, 0), (0, 0), (0, 1), (1, 1)]
+        for i, (clk, dt) in enumerate(states):
+            self.digital(t + i * period, ENC_CLK, clk)
+            self.digital(t + i * period, ENC_DT, dt)
+        return t + len(states) * period
+
+    def click(self, t, duration=50 * MS):
+        self.digital(t, ENC_SW, 0)
+        self.digital(t + duration, ENC_SW, 1)
+        return t + duration
+
+    def write(self, path):
+        data = bytearray(TRACE_MAGIC + bytes([TRACE_VERSION, TRACE_ANALOG_BITS]))
+        records = sorted(self.records, key=lambda r: r[0])
+        records.append((records[-1][0], REC_END, 0, 0, 0))
+        for t, kind, pin, channel, value in records:
+            data += struct.pack("<IBBBH", t, kind, pin, channel, value)
+        with open(path, "wb") as f:
+            f.write(data)
+
+
+def debounce():
+    """Drum pad 1 pressed and released with contact bounce: one hit. A 3 ms glitch on drum pad 2: nothing."""
+    t = Trace()
+    t.digital(0, ENC_SW, 1)
+    end = t.bounce(100 * MS, DRUM_ROWS[0], DRUM_COLS[0], True)
+    t.bounce(end + 100 * MS, DRUM_ROWS[0], DRUM_COLS[0], False)
+    t.key(400 * MS, DRUM_ROWS[0], DRUM_COLS[1], True)
+    t.key(403 * MS, DRUM_ROWS[0], DRUM_COLS[1], False)
+    return t
+
+
+def hold():
+    """Loop track 1: tap (start rec), then press (stop rec) and hold 3 s: clear after 0.5 s, clear all after 2 s."""
+    t = Trace()
+    t.digital(0, ENC_SW, 1)
+    t.key(100 * MS, TRACK_ROWS[0], TRACK_COLS[0], True)
+    t.key(200 * MS, TRACK_ROWS[0], TRACK_COLS[0], False)
+    t.key(1000 * MS, TRACK_ROWS[0], TRACK_COLS[0], True)
+    t.key(4000 * MS, TRACK_ROWS[0], TRACK_COLS[0], False)
+    return t
+
+
+def encoder():
+    """Menu: click "Load Sound", 5 slow detents CW (one step each), click: sound 5 ("Organ") is loaded."""
+    t = Trace()
+    t.digital(0, ENC_SW, 1)
+    now = t.click(100 * MS)
+    now += 200 * MS
+    for _ in range(5):
+        now = t.detent(now) + 200 * MS
+    t.click(now)
+    return t
+
+
+SCENARIOS = {"debounce": debounce, "hold": hold, "encoder": encoder}
+
+EXPECTED = {
+    "debounce": [("BTN_PRESSED", 0)],
+    "hold": [("LOOP_PRESSED", 0), ("LOOP_PRESSED", 0), ("CLEAR_LOOP", 0), ("CLEAR_ALL", 0)],
+    "encoder": [("DRUMPAD_SOUND", 5)],
+}
+
+
+def decode(tx):
+    """Serial1 stream -> [(channel, id)]. VOLUME messages (pots) are left out"""
+    messages = []
+    pos = 0
+    while pos + 3 <= len(tx):
+        flags = tx[pos]
+        channel = flags & ~(MSG_TIMESTAMP_FLAG | MSG_WIDE_FLAG)
+        size = 3 + (1 if flags & MSG_WIDE_FLAG else 0) + (4 if flags & MSG_TIMESTAMP_FLAG else 0)
+        name = CHANNELS[channel] if channel < len(CHANNELS) else str(channel)
+        if name != "VOLUME":
+            messages.append((name, tx[pos + 1]))
+        pos += size
+    return messages
+
+
+def run(program, name):
+    with tempfile.TemporaryDirectory() as tmp:
+        out = os.path.join(tmp, "tx.bin")
+        subprocess.run([program, os.path.join(DIR, name + ".trace"), out], check=True, stdout=subprocess.DEVNULL)
+        with open(out, "rb") as f:
+            return f.read()
+
+
+def main(argv):
+    if "--generate" in argv:
+        for name, scenario in SCENARIOS.items():
+            scenario().write(os.path.join(DIR, name + ".trace"))
+        return 0
+    if len(argv) < 2:
+        print(__doc__)
+        return 1
+    program = argv[1]
+    failed = 0
+    for name in SCENARIOS:
+        tx = run(program, name)
+        expected_path = os.path.join(DIR, name + ".tx")
+        if "--update" in argv:
+            with open(expected_path, "wb") as f:
+                f.write(tx)
+        with open(expected_path, "rb") as f:
+            expected = f.read()
+        messages = decode(tx)
+        if messages != EXPECTED[name]:
+            print("%s: FAIL messages %s, expected %s" % (name, messages, EXPECTED[name]))
+            failed += 1
+        elif tx != expected:
+            print("%s: FAIL %d bytes differ from %s.tx (same messages, different timing)" % (name, len(tx), name))
+            failed += 1
+        else:
+            print("%s: ok %s" % (name, messages))
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -9,6 +9,8 @@ from datetime import datetime
 import serial
 import os
 import enum
+import socket
+import collections
 
 
 class TrackState(enum.Enum):
@@ -23,6 +25,7 @@ class TrackState(enum.Enum):
 class MsgId(enum.Enum):
     STATUS = 0
     COUNTER = 1
+    LATENCY = 2     # Echo of a drum button sequence number, sent by PD once the sound is triggered
     
 class Button(enum.Enum):
     RELEASED = 0
@@ -35,17 +38,63 @@ class Py_to_pd:
     def __init__(self, pd_path, send_port):
         self.path = pd_path
         self.port = send_port
+        self.sock = None
 
-    def send2Pd(self, channel, ID='', value = ''):
+    def send2Pd(self, channel, ID='', value = '', delay = 0):
         """
-        Send messages from Python to PD.
+        Send messages from Python to PD, through a TCP connection kept open to its netreceive
+        (spawning pdsend for each message added milliseconds of jitter).
         channel: Link each message to a channel to be received in PD
             0: DSP status (0: off, 1: on)
             1: select_kit (int value)
         message: should be a string msg to be send as variable to PD
+        delay: ms to wait in PD before handling the message (timestamped events, see DueClock)
         """
-        os.system("echo '" + str(channel) + " " + str(ID) + " " + str(value) + ";' | "+
-            self.path + "pdsend " + str(self.port))
+        msg = str(channel) + " " + str(ID) + " " + str(value) + " " + "{:.2f}".format(delay) + ";\n"
+        try:
+            if self.sock is None:
+                self.sock = socket.create_connection(("localhost", self.port))
+                self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+            self.sock.sendall(msg.encode())
+        except OSError:
+            self.sock = None            # PD not running yet: message lost, connect again at the next one
+
+
+class DueClock:
+    """
+    Map the micros() timestamps of Arduino events to the local clock, to play every event at the same
+    latency from its detection.
+    The offset between the clocks is the smallest (arrival time - timestamp) of the last window seconds:
+    the message that waited the least on the serial link, the Arduino and Python. The window follows the drift
+    between the clocks.
+    """
+    def __init__(self, window):
+        self.window = window
+        self.offsets = collections.deque()  # (arrival, offset), increasing offsets: the first one is the minimum
+        self.last = None
+        self.wraps = 0
+
+    def delay(self, timestamp, arrival, latency):
+        """
+        Return the ms to wait, from arrival, to play an event latency ms after its detection (0 if already late).
+        timestamp: micros() of the Arduino
+        arrival: time.monotonic() when the message has been read
+        """
+        if self.last is not None and ((timestamp - self.last) & 0xFFFFFFFF) >= 0x80000000:
+            self.offsets.clear()            # Time went back: Arduino reset
+            self.wraps = 0
+        elif self.last is not None and timestamp < self.last:
+            self.wraps += 1                 # micros() overflow (every 71 minutes)
+        self.last = timestamp
+        t = (self.wraps * 0x100000000 + timestamp) / 1e6
+        offset = arrival - t
+        while self.offsets and self.offsets[-1][1] >= offset:
+            self.offsets.pop()
+        self.offsets.append((arrival, offset))
+        while self.offsets[0][0] < arrival - self.window:
+            self.offsets.popleft()
+        target = t + self.offsets[0][1] + latency / 1000
+        return max(0.0, (target - arrival) * 1000)
 
 
 def read_pd_input(proc, q):
@@ -96,21 +145,32 @@ def set_metronome(value, total_beats):
 
 def readSerial():
     """
-    Thread function reads the button_pad input
+    Thread function reads the button_pad input.
+    Messages are 3 bytes: channel, button id, value. When the channel has MSG_WIDE_FLAG, the value is 2 bytes
+    (little endian, 12 bit volumes). When the channel has MSG_TIMESTAMP_FLAG, 4 bytes follow:
+    micros() of the Arduino when the event was detected, little endian. PD delays those events so that they are
+    all played EVENT_LATENCY_MS after their detection.
     """
-    buff = [0,0,0]
-    i = 0
-    if(arduinoSerial.inWaiting() >= 3):
-        while(arduinoSerial.inWaiting()):
-            byte = arduinoSerial.read()
-            buff[i] = int.from_bytes(byte, byteorder='little', signed=False)
-            i = i +1
-            if(i==3):
-                i=0
-                ch = buff[0]
-                btnId = buff[1] + 1
-                value = buff[2]
-                send_msg.send2Pd(ch,btnId,value)
+    global rx_buffer
+    n = arduinoSerial.inWaiting()
+    if n == 0:
+        return
+    rx_buffer += arduinoSerial.read(n)
+    arrival = time.monotonic()
+    while len(rx_buffer) >= 3:
+        ch = rx_buffer[0]
+        wide = 1 if ch & MSG_WIDE_FLAG else 0
+        size = 3 + wide + (4 if ch & MSG_TIMESTAMP_FLAG else 0)
+        if len(rx_buffer) < size:
+            break
+        btnId = rx_buffer[1] + 1
+        value = int.from_bytes(rx_buffer[2:3 + wide], byteorder='little', signed=False)
+        delay = 0
+        if ch & MSG_TIMESTAMP_FLAG:
+            delay = due_clock.delay(int.from_bytes(rx_buffer[3 + wide:size], byteorder='little', signed=False), arrival, EVENT_LATENCY_MS)
+        ch &= ~(MSG_TIMESTAMP_FLAG | MSG_WIDE_FLAG)
+        del rx_buffer[:size]
+        send_msg.send2Pd(ch,btnId,value,delay)
                 
 
         
@@ -123,9 +183,15 @@ PORT_SEND_TO_PD = 3000          #port to communicate message TO PD
 PORT_RECEIVE_FROM_PD = 4000     #port to receive messages FROM PD
 SERIAL_PORT = '/dev/ttyS0'      #Serial port to communicate with Arduino
 SERIAL_BAUD_RATE = 115200       #serial speed
+MSG_TIMESTAMP_FLAG = 0x80       #channel byte flag of timestamped messages
+MSG_WIDE_FLAG = 0x40            #channel byte flag of messages with a 16 bit value
+EVENT_LATENCY_MS = 15           #fixed latency of timestamped events, from their detection on Arduino
+CLOCK_WINDOW_S = 10             #window of the Arduino/Raspberry clock offset estimate
 
 # Set up communication to PureData
 send_msg = Py_to_pd(PD_PATH, PORT_SEND_TO_PD)
+due_clock = DueClock(CLOCK_WINDOW_S)
+rx_buffer = bytearray()
 
 
 # start the socket